@@ -0,0 +1,66 @@
+/**
+ * @file
+ * Adaptive replacement cache policy for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#ifndef ARC_H
+#define ARC_H
+
+struct arc;
+struct mem_attr;
+
+/**
+ * Allocate ARC for a specific number of frames.
+ *
+ * The items are frame indexes within [0, capacity). Up to capacity keys
+ * evicted are remembered by their hashes.
+ *
+ * @param mem The attributes of the memory or NULL for the defaults.
+ */
+extern struct arc *arc_alloc(unsigned capacity, struct mem_attr const *mem);
+extern void arc_free(struct arc *arc);
+
+/**
+ * Add a frame of a key.
+ *
+ * A key evicted recently adapts the target size of the recency list and
+ * is added to the frequency list.
+ *
+ * @param hash The hash of the key.
+ */
+extern void arc_add(struct arc *arc, unsigned idx, unsigned hash);
+
+/** Move a frame to be the most recently used of the frequency list. */
+extern void arc_hit(struct arc *arc, unsigned idx);
+
+/**
+ * Extract the last recently used frame of the recency list if it is over
+ * the target or of the frequency list otherwise.
+ *
+ * The frame skip is passed over, the other list is taken if it is the
+ * only frame of the list chosen. At least one frame other than skip must
+ * be added.
+ *
+ * @param skip The frame not to extract or LRUL_NONE.
+ * @retval The index of the frame.
+ */
+extern unsigned arc_rm(struct arc *arc, unsigned skip);
+
+/** Remove a specific frame, its key is not remembered. */
+extern void arc_rm_item(struct arc *arc, unsigned idx);
+
+/**
+ * Get the frames of the recency list, then of the frequency list, from
+ * the last to the most recently used.
+ *
+ * Adding the frames in this order to a new ARC keeps their recency, not
+ * their lists and the keys evicted.
+ *
+ * @param idxs The frame indexes, up to n.
+ * @param n The number of frames added.
+ */
+extern void arc_order(struct arc *arc, unsigned *idxs, unsigned n);
+
+#endif /* ARC_H */
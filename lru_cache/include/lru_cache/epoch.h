@@ -0,0 +1,55 @@
+/**
+ * @file
+ * Epoch based reclamation for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdint.h>
+
+/**
+ * The number of epochs to pass since memory is retired until no reader
+ * can access it.
+ */
+#define EPOCH_GRACE 2U
+
+/**
+ * Enter a read section of the calling thread.
+ *
+ * Memory reachable within the section is not freed until the section is
+ * left. Sections may nest.
+ */
+extern void epoch_enter(void);
+
+/** Leave a read section of the calling thread. */
+extern void epoch_exit(void);
+
+/**
+ * Get the epoch to retire memory at.
+ *
+ * Memory made unreachable before the call is freed once the epoch is
+ * advanced EPOCH_GRACE times.
+ */
+extern uint64_t epoch_now(void);
+
+/**
+ * Advance the epoch if no thread reads in an older one.
+ *
+ * It walks the threads that ever entered a read section, so it is called
+ * for batches of memory retired rather than for every piece of it.
+ *
+ * @retval The epoch after the attempt.
+ */
+extern uint64_t epoch_advance(void);
+
+/**
+ * Wait for the read sections entered before the call to be left.
+ *
+ * It must not be called within a read section.
+ */
+extern void epoch_synchronize(void);
+
+#endif /* EPOCH_H */
@@ -9,10 +9,49 @@
 #define FRAMES_H
 
 struct frames;
+struct mem_attr;
 
-extern struct frames *frames_alloc(unsigned capacity);
+/**
+ * Allocate frames.
+ *
+ * @param mem The attributes of the frame memory or NULL for the defaults.
+ */
+extern struct frames *frames_alloc(unsigned capacity,
+                                   struct mem_attr const *mem);
 extern void frames_free(struct frames *frames);
 
+/**
+ * Defer the release of keys and values for readers without locks.
+ *
+ * A key and a value are never changed in place then, their memory is
+ * retired to the epoch it is released in and reused by frames_reclaim().
+ * Readers access frames within epoch_enter() and epoch_exit().
+ */
+extern void frames_defer(struct frames *frames);
+
+/**
+ * Reuse the memory of keys and values no reader can access.
+ *
+ * It is cheap to call on every change, the memory is reclaimed in
+ * batches.
+ */
+extern void frames_reclaim(struct frames *frames);
+
+/**
+ * Change the number of frames.
+ *
+ * The used frames keep their indexes, the ones past the new capacity are
+ * moved to the first unused frames, the keys and values are kept. No
+ * reader may access the frames meanwhile.
+ *
+ * @param capacity The new number of frames, not less than n.
+ * @param idxs The indexes of all used frames.
+ * @param n The number of used frames.
+ * @param to The index of the frame idxs[i] is set to to[i].
+ */
+extern void frames_resize(struct frames *frames, unsigned capacity,
+                          unsigned const *idxs, unsigned n, unsigned *to);
+
 /**
  * Check all frames are used.
  *
@@ -20,18 +59,124 @@ extern void frames_free(struct frames *frames);
  */
 extern int frames_all_used(struct frames *frames);
 
+/** Get the number of used frames. */
+extern unsigned frames_used(struct frames *frames);
+
+/**
+ * Get the memory a frame takes for its key and value.
+ *
+ * @param key_len The length of the key.
+ * @param value_len The length of the value.
+ * @retval The number of bytes.
+ */
+extern unsigned frames_data_size(unsigned key_len, unsigned value_len);
+
 /**
  * Make the next unused frame to be used.
  *
+ * The frame keeps no key and no value. Frames released by frames_rm() are
+ * reused first.
+ *
  * @retval The index of the frame.
  */
 extern unsigned frames_reserve(struct frames *frames);
 
 /**
- * Get the address of a frame.
+ * Make a used frame unused, its key and value are released.
+ *
+ * @param idx The index of the frame.
+ */
+extern void frames_rm(struct frames *frames, unsigned idx);
+
+/**
+ * Store a key and a value in a frame.
+ *
+ * The previous key and value of the frame are released.
+ *
+ * @param idx The index of the frame.
+ */
+extern void frames_set(struct frames *frames, unsigned idx,
+                       void const *key, unsigned key_len,
+                       void const *value, unsigned value_len);
+
+/**
+ * Replace the value of a frame.
+ *
+ * @param idx The index of the frame.
+ */
+extern void frames_set_value(struct frames *frames, unsigned idx,
+                             void const *value, unsigned value_len);
+
+/**
+ * Get the key of a frame.
+ *
+ * @param idx The index of the frame.
+ * @param len The length of the key.
+ * @retval The bytes of the key valid until the frame is changed.
+ */
+extern void const *frames_key(struct frames *frames, unsigned idx,
+                              unsigned *len);
+
+/**
+ * Get the value of a frame.
+ *
+ * @param idx The index of the frame.
+ * @param len The length of the value.
+ * @retval The bytes of the value valid until the frame is changed.
+ */
+extern void const *frames_value(struct frames *frames, unsigned idx,
+                                unsigned *len);
+
+/**
+ * Get the key and the value of a frame for a reader without locks.
+ *
+ * The bytes are not changed until they are released, so the key and the
+ * value of the same frame are read from them with frames_data_key_eq()
+ * and frames_data_value().
+ *
+ * @param idx The index of the frame, used or not.
+ * @retval The bytes of the frame or NULL for a frame with none.
+ */
+extern void const *frames_data(struct frames *frames, unsigned idx);
+
+/**
+ * Check the key of the bytes of a frame.
+ *
+ * @retval 1 if the bytes keep the key or 0 otherwise.
+ */
+extern int frames_data_key_eq(void const *data,
+                              void const *key, unsigned key_len);
+
+/**
+ * Get the value of the bytes of a frame.
+ *
+ * @param len The length of the value.
+ */
+extern void const *frames_data_value(void const *data, unsigned *len);
+
+/**
+ * Check the key of a frame.
+ *
+ * @retval 1 if the frame keeps the key or 0 otherwise.
+ */
+extern int frames_key_eq(struct frames *frames, unsigned idx,
+                         void const *key, unsigned key_len);
+
+/**
+ * Prefetch a frame to access it later.
+ *
+ * Only the information on the frame is prefetched, the key and the
+ * value are prefetched with frames_prefetch_data().
+ *
+ * @param idx The index of the frame.
+ */
+extern void frames_prefetch(struct frames *frames, unsigned idx);
+
+/**
+ * Prefetch the key and the value of a frame.
  *
  * @param idx The index of the frame.
  */
-extern int *frames_ref(struct frames *frames, unsigned idx);
+extern void frames_prefetch_data(struct frames *frames, unsigned idx);
 
 #endif
@@ -0,0 +1,38 @@
+/**
+ * @file
+ * Frequency sketch for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#ifndef FSKETCH_H
+#define FSKETCH_H
+
+struct fsketch;
+struct mem_attr;
+
+/**
+ * Allocate a sketch to estimate the frequencies of keys.
+ *
+ * The frequencies are halved once there are 10 times the capacity of
+ * keys added, so the sketch follows recent accesses.
+ *
+ * @param capacity The number of keys cached.
+ * @param mem The attributes of the sketch memory or NULL for the defaults.
+ */
+extern struct fsketch *fsketch_alloc(unsigned capacity,
+                                     struct mem_attr const *mem);
+extern void fsketch_free(struct fsketch *fs);
+
+/** Count an access to a key by its hash. */
+extern void fsketch_add(struct fsketch *fs, unsigned hash);
+
+/**
+ * Estimate the frequency of a key by its hash.
+ *
+ * @retval The number of accesses within [0, 15], never less than the
+ *         actual one since the last halving.
+ */
+extern unsigned fsketch_estimate(struct fsketch *fs, unsigned hash);
+
+#endif /* FSKETCH_H */
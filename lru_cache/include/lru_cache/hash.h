@@ -0,0 +1,30 @@
+/**
+ * @file
+ * Key hashing for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+
+/**
+ * Get a random non-zero seed.
+ *
+ * Caches hash with seeds of their own, so the keys colliding in one cache
+ * do not collide in another one.
+ */
+extern uint64_t hash_seed(void);
+
+/**
+ * Hash bytes with a seed.
+ *
+ * It is a wyhash-like multiply and fold hash: every bit of the result
+ * depends on every bit of the key and of the seed, so any bits of the
+ * hash may be used to index a table.
+ */
+extern unsigned hash_bytes(void const *key, unsigned len, uint64_t seed);
+
+#endif /* HASH_H */
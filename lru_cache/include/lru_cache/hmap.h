@@ -8,55 +8,115 @@
 #ifndef HMAP_H
 #define HMAP_H
 
-#include <sys/queue.h>
+/** The frame index meaning there is no frame. */
+#define HMAP_NONE (~0U)
+
+/** The number of bins of the probe length histogram. */
+#define HMAP_STATS_PROBES 16
 
 struct frames;
-struct lrul_item;
-
-/** HMap item */
-struct hmap_item {
-    CIRCLEQ_ENTRY(hmap_item) next;
-    /** The index of the associated frame. */
-    unsigned frame_idx;
-    /** The information on the frame usage. */
-    struct lrul_item *lrul_item;
+struct hmap;
+struct mem_attr;
+
+/** HMap statistics. */
+struct hmap_stats {
+    unsigned n_slots;
+    unsigned n_used;
+    unsigned n_deleted;
     /**
-     * The key.
-     *
-     * It must be set before the item is added into the map and
-     * must not be until the item is unmapped.
+     * probes[i] is the number of keys at a distance from the home slot
+     * within [2^i - 1, 2^(i + 1) - 1), the last bin includes larger ones.
      */
-    int key;
-    /** The index within the internal storage implementation. */
-    unsigned hmap_idx;
+    unsigned probes[HMAP_STATS_PROBES];
 };
 
-/** Allocate hmap item and associate it with an unused frame. */
-extern struct hmap_item *hmap_item_alloc(struct frames *frames);
-
 /**
  * Allocate hmap for a specific number of frames.
  *
+ * The keys are compared with the keys of the frames. The low bits of a
+ * key hash choose its home slot, so the hashes must be well mixed.
+ *
  * @param capacity The numer of frames to map.
+ * @param frames The frames to map.
+ * @param mem The attributes of the map memory or NULL for the defaults.
  */
-extern struct hmap *hmap_alloc(unsigned capacity);
+extern struct hmap *hmap_alloc(unsigned capacity, struct frames *frames,
+                               struct mem_attr const *mem);
 extern void hmap_free(struct hmap *hmap);
 
 /**
- * Get the hmap item for a key.
+ * Get the frame mapped for a key.
  *
- * @retval The item or NULL if there is no item for the key.
+ * @param hash The hash of the key.
+ * @retval The index of the frame or HMAP_NONE if there is no frame for
+ *         the key.
  */
-extern struct hmap_item *hmap_get(struct hmap *hmap, int key);
+extern unsigned hmap_get(struct hmap *hmap, void const *key, unsigned key_len,
+                         unsigned hash);
 
-/** Unmap an hmap item. */
-extern void hmap_rm(struct hmap *hmap, struct hmap_item *item);
+/** Prefetch the slots to look up a key hash later. */
+extern void hmap_prefetch(struct hmap *hmap, unsigned hash);
 
 /**
- * Map an hmap item.
+ * Get the first frame mapped for a key hash.
  *
- * The item has to be set with a key.
+ * The key of the frame is not compared, so it is a candidate to prefetch
+ * for a following hmap_get().
+ *
+ * @retval The index of the frame or HMAP_NONE.
  */
-extern void hmap_add(struct hmap *hmap, struct hmap_item *item);
+extern unsigned hmap_peek(struct hmap *hmap, unsigned hash);
+
+/**
+ * Get the hash a frame is mapped with.
+ *
+ * @param frame_idx The index of a frame mapped.
+ */
+extern unsigned hmap_hash(struct hmap *hmap, unsigned frame_idx);
+
+/**
+ * Unmap a frame.
+ *
+ * As hmap_add(), it moves a bounded part of the keys while the map drops
+ * deleted slots.
+ */
+extern void hmap_rm(struct hmap *hmap, unsigned frame_idx);
+
+/**
+ * Map a frame for the key it keeps.
+ *
+ * The key must not be mapped yet.
+ *
+ * Once few slots are empty, the keys are moved to another table to drop
+ * the deleted slots. Every addition and removal moves the keys of 16 slots
+ * at most, so none walks the whole table, while lookups probe both tables
+ * until the move is done.
+ *
+ * @param hash The hash of the key.
+ */
+extern void hmap_add(struct hmap *hmap, unsigned hash, unsigned frame_idx);
+
+/**
+ * Map a given number of frames.
+ *
+ * The frames up to the new number keep their keys. The keys are moved to
+ * a table sized for the new number of frames by the following additions
+ * and removals, as they drop deleted slots. Lookups may not run during
+ * the call.
+ *
+ * @param capacity The new number of frames, the frames mapped are below
+ *                 it.
+ */
+extern void hmap_resize(struct hmap *hmap, unsigned capacity);
+
+/**
+ * Map the key of a frame for another frame the key is moved to.
+ *
+ * @param to A frame not mapped.
+ */
+extern void hmap_move(struct hmap *hmap, unsigned from, unsigned to);
+
+/** Walk the map to get its statistics. */
+extern void hmap_stats(struct hmap *hmap, struct hmap_stats *stats);
 
 #endif /* HMAP_H */
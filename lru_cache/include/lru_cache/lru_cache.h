@@ -10,22 +10,392 @@
 
 struct lru_cache;
 
+/** The policy to choose the frame to reuse when all frames are used. */
+enum lru_cache_policy {
+    /** Evict the least recently used key. */
+    LRU_CACHE_POLICY_LRU = 0,
+    /**
+     * Evict a key not accessed for a turn of the CLOCK hand.
+     *
+     * A hit only sets a reference bit of the frame, so gets of a thread
+     * safe cache run under a shared lock.
+     */
+    LRU_CACHE_POLICY_CLOCK,
+    /**
+     * W-TinyLFU: new keys enter a small window LRU, a key leaving the
+     * window evicts the LRU victim of the rest of the cache only if a
+     * frequency sketch estimates it to be accessed more often.
+     *
+     * Keys accessed once, e.g. by scans, do not flush the frequent keys.
+     * Snapshots keep the recency of the keys, not their frequencies.
+     */
+    LRU_CACHE_POLICY_TINYLFU,
+    /**
+     * Segmented LRU: new keys are on probation, a hit moves a key to the
+     * protected segment of 80% of the frames. The least recently used key
+     * on probation is evicted first, so a scan does not evict the keys
+     * hit before.
+     *
+     * Snapshots keep the recency of the keys, not their segments.
+     */
+    LRU_CACHE_POLICY_SLRU,
+    /**
+     * Adaptive replacement cache: keys accessed once and keys accessed
+     * again are on separate lists, the split of the frames between them
+     * adapts to the puts of keys evicted from either list recently.
+     *
+     * The keys evicted are remembered by their hashes only, up to the
+     * capacity of them.
+     */
+    LRU_CACHE_POLICY_ARC,
+};
+
+/** The pages to back the frames, the hash map and the policy with. */
+enum lru_cache_pages {
+    /** Memory from malloc(). */
+    LRU_CACHE_PAGES_DEFAULT = 0,
+    /** Transparent huge pages, normal pages if they are disabled. */
+    LRU_CACHE_PAGES_HUGE,
+    /**
+     * Reserved huge pages of hugetlbfs, transparent huge pages if there are
+     * none free.
+     */
+    LRU_CACHE_PAGES_HUGETLB,
+};
+
+/** The NUMA placement of the cache memory. */
+enum lru_cache_numa {
+    /** The node of the thread touching the memory first. */
+    LRU_CACHE_NUMA_DEFAULT = 0,
+    /** The node lru_cache_attr.numa_node. */
+    LRU_CACHE_NUMA_BIND,
+    /** Pages interleaved across the nodes allowed for the process. */
+    LRU_CACHE_NUMA_INTERLEAVE,
+};
+
+/** The number of bins of the probe length histogram. */
+#define LRU_CACHE_STATS_PROBES 16
+
+/** LRU cache statistics. */
+struct lru_cache_stats {
+    /** Gets that found the key. */
+    unsigned long long hits;
+    /** Gets that did not find the key. */
+    unsigned long long misses;
+    /** Puts of a new key. */
+    unsigned long long inserts;
+    /** Puts of a key cached already. */
+    unsigned long long updates;
+    /** Keys evicted to insert another key. */
+    unsigned long long evictions;
+    /** Keys expired and reclaimed. */
+    unsigned long long expirations;
+    /** Values loaded by lru_cache_get_or_load(). */
+    unsigned long long loads;
+    /** Misses of lru_cache_get_or_load() that waited for another load. */
+    unsigned long long coalesced;
+    /**
+     * Hits not recorded by the policy: hits finding their read buffer
+     * full.
+     */
+    unsigned long long hits_dropped;
+    /** The weight of the cached keys for a cache with a weight budget. */
+    unsigned long long weight;
+    /** The number of hash map slots. */
+    unsigned n_slots;
+    /** The number of hash map slots keeping keys, i.e. cached keys. */
+    unsigned n_used;
+    /** The number of hash map slots of removed keys not reused yet. */
+    unsigned n_deleted;
+    /**
+     * The histogram of distances from the home slot of a key to its slot.
+     *
+     * probes[i] is the number of keys at a distance within
+     * [2^i - 1, 2^(i + 1) - 1), the last bin includes larger ones.
+     */
+    unsigned probes[LRU_CACHE_STATS_PROBES];
+};
+
+/** LRU cache attributes. */
+struct lru_cache_attr {
+    enum lru_cache_policy policy;
+    /**
+     * The number of shards within [1, capacity] for a thread safe cache
+     * or 0 for a cache that is not thread safe.
+     */
+    unsigned n_shards;
+    /**
+     * The seed of the key hashes or 0 for a random one.
+     *
+     * A random seed keeps the keys colliding in the cache unpredictable.
+     */
+    unsigned long long seed;
+    /**
+     * The pages of the cache memory.
+     *
+     * Huge pages cut TLB misses of lookups in large caches. Allocations
+     * smaller than a huge page use normal pages.
+     */
+    enum lru_cache_pages pages;
+    /** The NUMA placement, ignored if the system does not support it. */
+    enum lru_cache_numa numa;
+    unsigned numa_node;
+    /**
+     * The budget of the weights of the keys or 0 for none.
+     *
+     * With a budget, keys are evicted until the weights of the keys fit it
+     * as well as their number fits the capacity. The budget is split over
+     * the shards as the capacity is, a key heavier than the budget of its
+     * shard is not cached. A key weighs the memory of its key and value
+     * unless it is put with lru_cache_put_bytes_weight().
+     */
+    unsigned long long budget;
+    /**
+     * Look up keys without locks in a thread safe cache.
+     *
+     * Gets read the shards optimistically and look up again if a put
+     * races with them. Puts never change a value in place, and the memory
+     * of the keys and values replaced is reused once no get can read it.
+     *
+     * A hit of LRU_CACHE_POLICY_CLOCK sets its reference bit without
+     * locks. The hits of the other policies are buffered as with
+     * buffered_hits, which is implied, so gets take no lock unless they
+     * fill a buffer up.
+     */
+    int lockless;
+    /**
+     * Buffer the hits of a thread safe cache and record them in batches.
+     *
+     * A hit appends its frame to a small read buffer of the shard, so gets
+     * run under a shared lock, or none with lockless, instead of the
+     * exclusive one. The buffers are applied to the policy by a get filling
+     * one up if the shard is not locked, and by every put. A hit finding
+     * its buffer full is dropped. So, the order of the keys lags behind
+     * the hits by the buffered ones at most.
+     *
+     * It is ignored by LRU_CACHE_POLICY_CLOCK, which records hits under
+     * a shared lock already.
+     */
+    int buffered_hits;
+};
+
 /**
  * Create the LRU cache.
  *
+ * The cache is not thread safe.
+ *
  * @param capacity The numter of frames within the cache.
  */
 extern struct lru_cache *lru_cache_alloc(unsigned capacity);
+
+/**
+ * Create the thread safe LRU cache.
+ *
+ * Keys are partitioned by hash across shards, each shard is an LRU cache
+ * for its keys with its own lock. So, the least recently used key is
+ * evicted within a shard.
+ *
+ * @param capacity The numter of frames within the cache.
+ * @param n_shards The number of shards within [1, capacity].
+ */
+extern struct lru_cache *lru_cache_sharded_alloc(unsigned capacity,
+                                                 unsigned n_shards);
+
+/**
+ * Create the LRU cache with specific attributes.
+ *
+ * @param capacity The numter of frames within the cache.
+ * @param attr The attributes or NULL for the defaults of lru_cache_alloc().
+ */
+extern struct lru_cache *lru_cache_alloc_attr(unsigned capacity,
+                                              struct lru_cache_attr const *attr);
 extern void lru_cache_free(struct lru_cache *cache);
 
+/** Cached bytes. */
+struct lru_cache_view {
+    void const *data;
+    unsigned len;
+};
+
+/**
+ * Cache a value with a specific key.
+ *
+ * The key and the value are copied into the cache storage.
+ */
+extern void lru_cache_put_bytes(struct lru_cache *cache,
+                                void const *key, unsigned key_len,
+                                void const *value, unsigned value_len);
+
+/**
+ * Cache a value with a specific key for a time.
+ *
+ * Once the time passes, gets of the key miss and the frame of the key is
+ * reused before any live key is evicted. A put of the key without a TTL
+ * makes it live until it is evicted.
+ *
+ * @param ttl The time to live in milliseconds or 0 for no expiration.
+ */
+extern void lru_cache_put_bytes_ttl(struct lru_cache *cache,
+                                    void const *key, unsigned key_len,
+                                    void const *value, unsigned value_len,
+                                    unsigned ttl);
+
+/**
+ * Cache a value with a specific key and weight.
+ *
+ * The weight is ignored by a cache without a budget.
+ *
+ * @param weight The weight of the key.
+ * @see lru_cache_attr.budget
+ */
+extern void lru_cache_put_bytes_weight(struct lru_cache *cache,
+                                       void const *key, unsigned key_len,
+                                       void const *value, unsigned value_len,
+                                       unsigned weight);
+
+/**
+ * Retrieve the value for a specific key without copying it.
+ *
+ * The value is valid until the next put into the cache. So, for a thread
+ * safe cache, use lru_cache_copy_bytes() unless puts are excluded.
+ *
+ * @param value The value found.
+ * @retval 1 if the value is found or 0 otherwise.
+ */
+extern int lru_cache_get_bytes(struct lru_cache *cache,
+                               void const *key, unsigned key_len,
+                               struct lru_cache_view *value);
+
+/**
+ * Copy the value for a specific key.
+ *
+ * @param buf The buffer to copy the value to, up to size bytes.
+ * @retval The length of the value or -1 if there is no value for the key.
+ */
+extern long lru_cache_copy_bytes(struct lru_cache *cache,
+                                 void const *key, unsigned key_len,
+                                 void *buf, unsigned size);
+
 /** Cache a value with a specific key. */
 extern void lru_cache_put(struct lru_cache *cache, int key, int value);
 
+/**
+ * Cache a value with a specific key for a time.
+ *
+ * @param ttl The time to live in milliseconds or 0 for no expiration.
+ * @see lru_cache_put_bytes_ttl()
+ */
+extern void lru_cache_put_ttl(struct lru_cache *cache, int key, int value,
+                              unsigned ttl);
+
 /**
  * Retrieve the value for a specific key.
  *
- * @retval The value or -1 if there is no value for the key.
+ * @retval The value or -1 if there is no int value for the key.
  */
 extern int lru_cache_get(struct lru_cache *cache, int key);
 
+/**
+ * Load the value for a key on a miss.
+ *
+ * @param ctx The context passed to lru_cache_get_or_load().
+ * @param value The value loaded.
+ * @retval 0 if the value is loaded or an error otherwise.
+ */
+typedef int (*lru_cache_load_t)(void *ctx, int key, int *value);
+
+/**
+ * Retrieve the value for a specific key, load and cache it on a miss.
+ *
+ * The load runs without locks held. For a thread safe cache, concurrent
+ * misses of a key wait for one load of the key and share its result.
+ *
+ * @param load The function to load the value.
+ * @param ctx The context of the load.
+ * @param value The value, unchanged if the load fails.
+ * @retval 0 if the value is found or loaded or the error of the load.
+ */
+extern int lru_cache_get_or_load(struct lru_cache *cache, int key,
+                                 lru_cache_load_t load, void *ctx,
+                                 int *value);
+
+/**
+ * Retrieve the values for a batch of keys.
+ *
+ * It is the same as lru_cache_get() for every key in turn, but the memory
+ * accesses of the keys are overlapped.
+ *
+ * @param keys The keys.
+ * @param n The number of keys.
+ * @param values The values or -1 for every key.
+ */
+extern void lru_cache_get_many(struct lru_cache *cache, int const *keys,
+                               unsigned n, int *values);
+
+/**
+ * Cache a batch of values.
+ *
+ * It is the same as lru_cache_put() for every key in turn, but the memory
+ * accesses of the keys are overlapped.
+ *
+ * @param keys The keys.
+ * @param n The number of keys.
+ * @param values The values for every key.
+ */
+extern void lru_cache_put_many(struct lru_cache *cache, int const *keys,
+                               unsigned n, int const *values);
+
+/**
+ * Change the capacity of a cache.
+ *
+ * The keys are kept in their order, the keys to reuse first are evicted
+ * if there are more keys than the new capacity. The capacity is split over
+ * the shards as lru_cache_alloc_attr() splits it. The order of the keys is
+ * kept as a snapshot keeps it.
+ *
+ * The hash map moves the keys to a table of the new size by the puts that
+ * follow, but the policy and the TTLs are rebuilt in one pass, so a shard
+ * pauses in proportion to its keys: about 100ms to grow or shrink a shard
+ * of 1M keys, see lrucachebench -R.
+ *
+ * A shard is locked while it is resized, so gets and puts of a thread
+ * safe cache may run meanwhile, but resizes and saves may not.
+ *
+ * @param capacity The new number of frames, not less than the number of
+ *                 shards.
+ */
+extern void lru_cache_resize(struct lru_cache *cache, unsigned capacity);
+
+/**
+ * Get the statistics of a cache.
+ *
+ * The counters are kept all the time, the hash map is walked to get the
+ * slot counters and the histogram.
+ */
+extern void lru_cache_stats(struct lru_cache *cache,
+                            struct lru_cache_stats *stats);
+
+/**
+ * Save the keys and values of a cache with their order to a file.
+ *
+ * The keys are saved in the order the policy reuses their frames. The
+ * reference bits of LRU_CACHE_POLICY_CLOCK, the frequencies of
+ * LRU_CACHE_POLICY_TINYLFU, the segments of LRU_CACHE_POLICY_SLRU and
+ * LRU_CACHE_POLICY_ARC, the keys evicted by LRU_CACHE_POLICY_ARC and the
+ * keys with a TTL are not saved. The file is replaced once the snapshot is
+ * written completely. The snapshot is in the host byte order.
+ *
+ * @retval 0 on success or -1 with errno set otherwise.
+ */
+extern int lru_cache_save(struct lru_cache *cache, char const *path);
+
+/**
+ * Create a cache from a snapshot saved by lru_cache_save().
+ *
+ * The cache has the capacity and the attributes of the saved one.
+ *
+ * @retval The cache or NULL if the snapshot cannot be read or is malformed.
+ */
+extern struct lru_cache *lru_cache_load(char const *path);
+
 #endif /* LRU_CACHE_H */
@@ -0,0 +1,249 @@
+/**
+ * @file
+ * Type specialized LRU cache
+ *
+ * LRU_CACHE_DEFINE() generates an LRU cache for a key type and a value
+ * type as static inline functions, so the compiler inlines hashing and
+ * comparing the keys into the lookups, and keys and values are stored as
+ * they are instead of as bytes. It needs no library.
+ *
+ * A generated cache is not thread safe, it evicts the least recently used
+ * key, and it has no TTLs, budget or statistics.
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#ifndef LRU_CACHE_DEFINE_H
+#define LRU_CACHE_DEFINE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Every frame keeps a key, its value and its hash, and it is linked to
+ * the LRU list by indexes. The frame capacity is the head of the list.
+ *
+ * The keys are mapped by a linear probing table of at least twice as many
+ * slots as frames. A slot keeps the hash next to the frame index, so a
+ * probe reads the frame of a matching hash only. A removed slot is filled
+ * with the following slots that may move back, so there are no deleted
+ * slots to drop later and no operation walks the table.
+ */
+
+/** The frame index meaning there is no frame. */
+#define LRU_CACHE_DEFINE_NONE (~0U)
+
+/** The minimum number of slots of a generated cache. */
+#define LRU_CACHE_DEFINE_SLOTS_MIN 16U
+
+struct lru_cache_define_slot {
+    unsigned hash;
+    unsigned idx;
+};
+
+/**
+ * Mix a 64-bit key into a hash for a generated cache.
+ *
+ * The low bits of a hash choose the home slot of the key, so the hashes
+ * of LRU_CACHE_DEFINE() must be well mixed.
+ */
+static inline unsigned lru_cache_hash_u64(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+
+    return (unsigned) key;
+}
+
+/**
+ * Define an LRU cache struct _name of _key_t keys and _value_t values.
+ *
+ * The functions defined are:
+ *   struct _name *_name_alloc(unsigned capacity)
+ *     Create the cache, NULL if capacity is 0 or memory is short.
+ *   void _name_free(struct _name *cache)
+ *   _value_t *_name_get(struct _name *cache, _key_t const *key)
+ *     Get the value of a key or NULL. The value is valid until the next
+ *     put.
+ *   void _name_put(struct _name *cache, _key_t const *key,
+ *                  _value_t const *value)
+ *     Cache a copy of a value for a copy of a key.
+ *
+ * @param _hash unsigned _hash(_key_t const *key), the hashes must be well
+ *              mixed, e.g. by lru_cache_hash_u64().
+ * @param _eq int _eq(_key_t const *a, _key_t const *b), nonzero for
+ *            equal keys.
+ */
+#define LRU_CACHE_DEFINE(_name, _key_t, _value_t, _hash, _eq) \
+    struct _name ## _frame { \
+        _key_t key; \
+        _value_t value; \
+        unsigned hash; \
+        unsigned prev; \
+        unsigned next; \
+    }; \
+    \
+    struct _name { \
+        struct _name ## _frame *frames; \
+        struct lru_cache_define_slot *slots; \
+        unsigned mask; \
+        unsigned capacity; \
+        unsigned size; \
+    }; \
+    \
+    static inline struct _name *_name ## _alloc(unsigned capacity) \
+    { \
+        struct _name *cache; \
+        unsigned n = LRU_CACHE_DEFINE_SLOTS_MIN; \
+        unsigned i; \
+        \
+        if (!capacity || capacity > (1U << 30)) \
+            return NULL; \
+        \
+        while (n < 2 * capacity) \
+            n <<= 1; \
+        \
+        cache = calloc(1, sizeof(*cache)); \
+        if (!cache) \
+            return NULL; \
+        \
+        cache->frames = malloc((capacity + 1) * sizeof(*cache->frames)); \
+        cache->slots = malloc(n * sizeof(*cache->slots)); \
+        if (!cache->frames || !cache->slots) { \
+            free(cache->frames); \
+            free(cache->slots); \
+            free(cache); \
+            return NULL; \
+        } \
+        \
+        for (i = 0; i < n; ++i) \
+            cache->slots[i].idx = LRU_CACHE_DEFINE_NONE; \
+        \
+        cache->frames[capacity].prev = capacity; \
+        cache->frames[capacity].next = capacity; \
+        cache->mask = n - 1; \
+        cache->capacity = capacity; \
+        \
+        return cache; \
+    } \
+    \
+    static inline void _name ## _free(struct _name *cache) \
+    { \
+        free(cache->slots); \
+        free(cache->frames); \
+        free(cache); \
+    } \
+    \
+    /* Find the slot of a key or the empty slot to map it at. */ \
+    static inline unsigned _name ## _find(struct _name *cache, \
+                                          _key_t const *key, unsigned hash) \
+    { \
+        struct lru_cache_define_slot const *slot; \
+        unsigned pos = hash & cache->mask; \
+        \
+        for (;; pos = (pos + 1) & cache->mask) { \
+            slot = cache->slots + pos; \
+            if (slot->idx == LRU_CACHE_DEFINE_NONE || \
+                (slot->hash == hash && \
+                 _eq(&cache->frames[slot->idx].key, key))) \
+                return pos; \
+        } \
+    } \
+    \
+    /* Unmap a frame, moving back the slots probed past its slot. */ \
+    static inline void _name ## _unmap(struct _name *cache, unsigned idx) \
+    { \
+        struct lru_cache_define_slot *slots = cache->slots; \
+        unsigned pos = cache->frames[idx].hash & cache->mask; \
+        unsigned next; \
+        unsigned home; \
+        \
+        while (slots[pos].idx != idx) \
+            pos = (pos + 1) & cache->mask; \
+        \
+        for (next = (pos + 1) & cache->mask; \
+             slots[next].idx != LRU_CACHE_DEFINE_NONE; \
+             next = (next + 1) & cache->mask) { \
+            home = slots[next].hash & cache->mask; \
+            if (((next - home) & cache->mask) >= \
+                ((next - pos) & cache->mask)) { \
+                slots[pos] = slots[next]; \
+                pos = next; \
+            } \
+        } \
+        \
+        slots[pos].idx = LRU_CACHE_DEFINE_NONE; \
+    } \
+    \
+    static inline void _name ## _unlink(struct _name *cache, unsigned idx) \
+    { \
+        struct _name ## _frame *f = cache->frames; \
+        \
+        f[f[idx].prev].next = f[idx].next; \
+        f[f[idx].next].prev = f[idx].prev; \
+    } \
+    \
+    /* Link a frame to be the most recently used. */ \
+    static inline void _name ## _link(struct _name *cache, unsigned idx) \
+    { \
+        struct _name ## _frame *f = cache->frames; \
+        unsigned head = cache->capacity; \
+        \
+        f[idx].prev = head; \
+        f[idx].next = f[head].next; \
+        f[f[head].next].prev = idx; \
+        f[head].next = idx; \
+    } \
+    \
+    static inline _value_t *_name ## _get(struct _name *cache, \
+                                          _key_t const *key) \
+    { \
+        unsigned idx = cache->slots[_name ## _find(cache, key, \
+                                                   _hash(key))].idx; \
+        \
+        if (idx == LRU_CACHE_DEFINE_NONE) \
+            return NULL; \
+        \
+        if (cache->frames[cache->capacity].next != idx) { \
+            _name ## _unlink(cache, idx); \
+            _name ## _link(cache, idx); \
+        } \
+        \
+        return &cache->frames[idx].value; \
+    } \
+    \
+    static inline void _name ## _put(struct _name *cache, \
+                                     _key_t const *key, \
+                                     _value_t const *value) \
+    { \
+        unsigned hash = _hash(key); \
+        unsigned pos = _name ## _find(cache, key, hash); \
+        unsigned idx = cache->slots[pos].idx; \
+        \
+        if (idx != LRU_CACHE_DEFINE_NONE) { \
+            _name ## _unlink(cache, idx); \
+        } else { \
+            if (cache->size < cache->capacity) { \
+                idx = cache->size++; \
+            } else { \
+                idx = cache->frames[cache->capacity].prev; \
+                _name ## _unlink(cache, idx); \
+                _name ## _unmap(cache, idx); \
+                /* The slots following the evicted one may move back. */ \
+                pos = _name ## _find(cache, key, hash); \
+            } \
+            \
+            cache->slots[pos].hash = hash; \
+            cache->slots[pos].idx = idx; \
+            cache->frames[idx].key = *key; \
+            cache->frames[idx].hash = hash; \
+        } \
+        \
+        cache->frames[idx].value = *value; \
+        _name ## _link(cache, idx); \
+    }
+
+#endif /* LRU_CACHE_DEFINE_H */
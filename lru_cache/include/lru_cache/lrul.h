@@ -8,31 +8,60 @@
 #ifndef LRUL_H
 #define LRUL_H
 
-#include <sys/queue.h>
-
-struct hmap_item;
 struct lrul;
+struct mem_attr;
 
-/** The LRU information on a frame. */
-struct lrul_item {
-    CIRCLEQ_ENTRY(lrul_item) next;
-    /** The HMap item associated with the frame. */
-    struct hmap_item *hmap_item;
-};
-
-extern struct lrul_item *lrul_item_alloc(struct hmap_item *hmap_item);
-extern void lrul_item_free(struct lrul_item *item);
+/** No frame. */
+#define LRUL_NONE (~0U)
 
-extern struct lrul *lrul_alloc(void);
+/**
+ * Allocate lists for a specific number of frames.
+ *
+ * The list items are frame indexes within [0, capacity), a frame is on
+ * one list at most. Lists are numbered within [0, n_lists).
+ *
+ * @param mem The attributes of the list memory or NULL for the defaults.
+ */
+extern struct lrul *lrul_alloc(unsigned capacity, unsigned n_lists,
+                               struct mem_attr const *mem);
 extern void lrul_free(struct lrul *lrul);
 
-/** Add the item to be the most recently used. */
-extern void lrul_add(struct lrul *lrul, struct lrul_item *item);
+/** Add the frame to be the most recently used of a list. */
+extern void lrul_add(struct lrul *lrul, unsigned list, unsigned idx);
 
-/** Extract the last recently used item. */
-extern struct lrul_item *lrul_rm(struct lrul *lrul);
+/**
+ * Extract the last recently used frame of a list.
+ *
+ * @retval The index of the frame.
+ */
+extern unsigned lrul_rm(struct lrul *lrul, unsigned list);
 
-/** Remove a specific item. */
-extern void lrul_rm_item(struct lrul *lrul, struct lrul_item *item);
+/** Remove a specific frame. */
+extern void lrul_rm_item(struct lrul *lrul, unsigned idx);
+
+/**
+ * Get the last recently used frame of a list.
+ *
+ * @retval The index of the frame or LRUL_NONE if the list is empty.
+ */
+extern unsigned lrul_tail(struct lrul *lrul, unsigned list);
+
+/**
+ * Get the last recently used frame of a list other than a frame.
+ *
+ * @param skip The frame not to get or LRUL_NONE.
+ * @retval The index of the frame or LRUL_NONE if there is none.
+ */
+extern unsigned lrul_tail_skip(struct lrul *lrul, unsigned list,
+                               unsigned skip);
+
+/**
+ * Get the frames of a list from the last to the most recently used.
+ *
+ * @param idxs The frame indexes, up to n.
+ * @param n The number of frames in the list.
+ */
+extern void lrul_order(struct lrul *lrul, unsigned list, unsigned *idxs,
+                       unsigned n);
 
 #endif /* LRUL_H */
@@ -0,0 +1,80 @@
+/**
+ * @file
+ * Backing memory for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#ifndef MEM_H
+#define MEM_H
+
+#include <stddef.h>
+
+/** The pages to back large allocations with. */
+enum mem_pages {
+    /** Memory from malloc(). */
+    MEM_PAGES_DEFAULT = 0,
+    /** Transparent huge pages, normal pages if they are disabled. */
+    MEM_PAGES_HUGE,
+    /** Reserved huge pages, transparent ones if there are none free. */
+    MEM_PAGES_HUGETLB,
+};
+
+/** The NUMA placement of allocations. */
+enum mem_numa {
+    /** The node of the thread touching the memory first. */
+    MEM_NUMA_DEFAULT = 0,
+    /** A specific node. */
+    MEM_NUMA_BIND,
+    /** Pages interleaved across the nodes allowed for the process. */
+    MEM_NUMA_INTERLEAVE,
+};
+
+/** The size of a huge page. */
+#define MEM_HUGE_PAGE_SIZE (2UL << 20)
+
+struct mem_attr {
+    enum mem_pages pages;
+    enum mem_numa numa;
+    /** The node for MEM_NUMA_BIND. */
+    unsigned node;
+};
+
+/**
+ * Allocate memory, the memory is not initialized.
+ *
+ * Allocations smaller than a huge page use normal pages. A placement the
+ * system does not support is ignored.
+ *
+ * @param attr The attributes or NULL for the defaults.
+ */
+extern void *mem_alloc(size_t size, struct mem_attr const *attr);
+
+/**
+ * Allocate aligned memory, the memory is not initialized.
+ *
+ * @param align A power of 2 up to a huge page.
+ * @see mem_alloc()
+ */
+extern void *mem_alloc_aligned(size_t size, size_t align,
+                               struct mem_attr const *attr);
+
+/**
+ * Allocate memory filled with zeros.
+ *
+ * The pages mapped for it are not touched, so they are zeroed as they are
+ * faulted in rather than all at once.
+ *
+ * @see mem_alloc()
+ */
+extern void *mem_zalloc(size_t size, struct mem_attr const *attr);
+
+/**
+ * Free memory.
+ *
+ * @param size The size the memory is allocated with.
+ * @param attr The attributes the memory is allocated with.
+ */
+extern void mem_free(void *p, size_t size, struct mem_attr const *attr);
+
+#endif /* MEM_H */
@@ -0,0 +1,73 @@
+/**
+ * @file
+ * Frame replacement policies for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#ifndef POLICY_H
+#define POLICY_H
+
+struct mem_attr;
+
+/** No frame. */
+#define POLICY_NONE (~0U)
+
+/**
+ * Replacement policy operations.
+ *
+ * A policy tracks the used frames of a cache and chooses the frame to
+ * reuse when all frames are used.
+ */
+struct policy_ops {
+    void *(*alloc)(unsigned capacity, struct mem_attr const *mem);
+    void (*free)(void *policy);
+    /** A frame gets used by a key with a hash. */
+    void (*add)(void *policy, unsigned idx, unsigned hash);
+    /** A used frame is accessed. */
+    void (*hit)(void *policy, unsigned idx);
+    /**
+     * Extract the frame to reuse other than the used frame skip, which
+     * keeps its place, or POLICY_NONE.
+     */
+    unsigned (*rm)(void *policy, unsigned skip);
+    /** Remove a used frame. */
+    void (*rm_item)(void *policy, unsigned idx);
+    /**
+     * Get the n used frames in the order to reuse them.
+     *
+     * Adding the frames in this order to a new policy gives the same order.
+     */
+    void (*order)(void *policy, unsigned *idxs, unsigned n);
+    /**
+     * The hit operation may run concurrently with other hits and, for a
+     * frame found without locks, with any other operation.
+     */
+    int shared_hit;
+};
+
+/** Least recently used frame is reused. */
+extern struct policy_ops const policy_lru_ops;
+
+/** Second chance CLOCK: a frame not accessed for a hand turn is reused. */
+extern struct policy_ops const policy_clock_ops;
+
+/**
+ * Segmented LRU: new frames are on probation until they are hit, frames
+ * are reused from probation first.
+ */
+extern struct policy_ops const policy_slru_ops;
+
+/**
+ * W-TinyLFU: a frame leaving the window LRU replaces the victim of the
+ * main segment if its key is estimated to be accessed more often.
+ */
+extern struct policy_ops const policy_tinylfu_ops;
+
+/**
+ * ARC: the frames are split between a recency and a frequency list by a
+ * target adapted by the hits of keys evicted recently.
+ */
+extern struct policy_ops const policy_arc_ops;
+
+#endif /* POLICY_H */
@@ -0,0 +1,59 @@
+/**
+ * @file
+ * Second chance CLOCK for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#ifndef SCLK_H
+#define SCLK_H
+
+struct sclk;
+struct mem_attr;
+
+/** No frame. */
+#define SCLK_NONE (~0U)
+
+/**
+ * Allocate the clock for a specific number of frames.
+ *
+ * The clock items are frame indexes within [0, capacity).
+ *
+ * @param mem The attributes of the clock memory or NULL for the defaults.
+ */
+extern struct sclk *sclk_alloc(unsigned capacity, struct mem_attr const *mem);
+extern void sclk_free(struct sclk *sclk);
+
+/** Add a frame not referenced yet. */
+extern void sclk_add(struct sclk *sclk, unsigned idx);
+
+/**
+ * Mark a frame as referenced.
+ *
+ * It is safe to call concurrently with other sclk_ref() calls.
+ */
+extern void sclk_ref(struct sclk *sclk, unsigned idx);
+
+/** Remove a specific frame. */
+extern void sclk_rm_item(struct sclk *sclk, unsigned idx);
+
+/**
+ * Extract a frame not referenced since the hand passed it last time.
+ *
+ * The hand passes the frame skip with its reference bit kept. At least
+ * one frame other than skip must be added.
+ *
+ * @param skip The frame not to extract or SCLK_NONE.
+ * @retval The index of the frame.
+ */
+extern unsigned sclk_rm(struct sclk *sclk, unsigned skip);
+
+/**
+ * Get the frames in the order the hand passes them.
+ *
+ * @param idxs The frame indexes, up to n.
+ * @param n The number of frames added.
+ */
+extern void sclk_order(struct sclk *sclk, unsigned *idxs, unsigned n);
+
+#endif /* SCLK_H */
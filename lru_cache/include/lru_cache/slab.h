@@ -0,0 +1,41 @@
+/**
+ * @file
+ * Slab allocator for LRU frames
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#ifndef SLAB_H
+#define SLAB_H
+
+struct slab;
+struct mem_attr;
+
+/**
+ * Allocate a slab.
+ *
+ * @param mem The attributes of the page memory or NULL for the defaults.
+ */
+extern struct slab *slab_alloc(struct mem_attr const *mem);
+
+/** Free the slab with all chunks allocated from it. */
+extern void slab_free(struct slab *slab);
+
+/**
+ * Get the size of the chunk allocated for a number of bytes.
+ *
+ * Chunks of the same size are interchangeable.
+ */
+extern unsigned slab_chunk_size(unsigned size);
+
+/** Allocate a chunk for a number of bytes. */
+extern void *slab_get(struct slab *slab, unsigned size);
+
+/**
+ * Release a chunk.
+ *
+ * @param size The number of bytes the chunk is allocated for.
+ */
+extern void slab_put(struct slab *slab, void *chunk, unsigned size);
+
+#endif /* SLAB_H */
@@ -0,0 +1,56 @@
+/**
+ * @file
+ * Segmented LRU for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#ifndef SLRU_H
+#define SLRU_H
+
+struct slru;
+struct mem_attr;
+
+/**
+ * Allocate the segmented LRU for a specific number of frames.
+ *
+ * The items are frame indexes within [0, capacity).
+ *
+ * @param mem The attributes of the memory or NULL for the defaults.
+ */
+extern struct slru *slru_alloc(unsigned capacity, struct mem_attr const *mem);
+extern void slru_free(struct slru *slru);
+
+/** Add a frame to the probation segment. */
+extern void slru_add(struct slru *slru, unsigned idx);
+
+/** Move a frame to be the most recently used of the protected segment. */
+extern void slru_hit(struct slru *slru, unsigned idx);
+
+/**
+ * Extract the last recently used frame of probation or of the protected
+ * segment if probation is empty.
+ *
+ * At least one frame other than skip must be added.
+ *
+ * @param skip The frame not to extract or LRUL_NONE.
+ * @retval The index of the frame.
+ */
+extern unsigned slru_rm(struct slru *slru, unsigned skip);
+
+/** Remove a specific frame. */
+extern void slru_rm_item(struct slru *slru, unsigned idx);
+
+/**
+ * Get the frames of probation, then of the protected segment, from the
+ * last to the most recently used.
+ *
+ * Adding the frames in this order to a new SLRU keeps their recency, not
+ * their segments.
+ *
+ * @param idxs The frame indexes, up to n.
+ * @param n The number of frames added.
+ */
+extern void slru_order(struct slru *slru, unsigned *idxs, unsigned n);
+
+#endif /* SLRU_H */
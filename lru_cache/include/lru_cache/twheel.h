@@ -0,0 +1,68 @@
+/**
+ * @file
+ * Hierarchical timing wheel for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#ifndef TWHEEL_H
+#define TWHEEL_H
+
+#include <stdint.h>
+
+struct twheel;
+struct mem_attr;
+
+/** Called for a frame expired, the frame is removed from the wheel. */
+typedef void (*twheel_expire_t)(void *ctx, unsigned idx);
+
+/**
+ * Allocate the wheel for a specific number of frames.
+ *
+ * The wheel items are frame indexes within [0, capacity), the time is
+ * counted in ticks.
+ *
+ * @param now The current tick.
+ * @param mem The attributes of the wheel memory or NULL for the defaults.
+ */
+extern struct twheel *twheel_alloc(unsigned capacity, uint64_t now,
+                                   struct mem_attr const *mem);
+extern void twheel_free(struct twheel *tw);
+
+/**
+ * Add a frame to expire at a specific tick.
+ *
+ * The frame must not be in the wheel. A frame to expire at the current
+ * tick or before expires at the next one, so the wheel is advanced to the
+ * current tick first, even if it is empty.
+ */
+extern void twheel_add(struct twheel *tw, unsigned idx, uint64_t expire);
+
+/** Remove a frame from the wheel if it is there. */
+extern void twheel_rm(struct twheel *tw, unsigned idx);
+
+/**
+ * Get the tick a frame expires at.
+ *
+ * It may be called without the lock of the wheel, the tick read is one
+ * set for the frame or 0.
+ *
+ * @retval The tick or 0 if the frame is not in the wheel.
+ */
+extern uint64_t twheel_expire(struct twheel *tw, unsigned idx);
+
+/** Get the number of frames in the wheel. */
+extern unsigned twheel_size(struct twheel *tw);
+
+/**
+ * Advance the wheel and expire the frames up to a tick.
+ *
+ * The time is amortized O(1) per frame expired or cascaded, whatever the
+ * number of ticks passed: the wheel skips the slots with no frames. A
+ * frame beyond the reach of the top level is cascaded once per 2^18
+ * ticks.
+ */
+extern void twheel_advance(struct twheel *tw, uint64_t now,
+                           twheel_expire_t expire, void *ctx);
+
+#endif /* TWHEEL_H */
@@ -0,0 +1,65 @@
+/**
+ * @file
+ * W-TinyLFU for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#ifndef WTLFU_H
+#define WTLFU_H
+
+struct wtlfu;
+struct mem_attr;
+
+/**
+ * Allocate W-TinyLFU for a specific number of frames.
+ *
+ * The items are frame indexes within [0, capacity).
+ *
+ * @param mem The attributes of the memory or NULL for the defaults.
+ */
+extern struct wtlfu *wtlfu_alloc(unsigned capacity,
+                                 struct mem_attr const *mem);
+extern void wtlfu_free(struct wtlfu *wtlfu);
+
+/**
+ * Add a frame of a key to the window.
+ *
+ * @param hash The hash of the key.
+ */
+extern void wtlfu_add(struct wtlfu *wtlfu, unsigned idx, unsigned hash);
+
+/** Count an access to a frame and promote it. */
+extern void wtlfu_hit(struct wtlfu *wtlfu, unsigned idx);
+
+/**
+ * Extract the frame to reuse for a key added next.
+ *
+ * The last recently used frame of the window is admitted to the main
+ * segment if its key is more frequent than the key of the victim of the
+ * main segment. The one not admitted or evicted is extracted.
+ *
+ * The frame skip is neither a candidate nor a victim. At least one frame
+ * other than skip must be added.
+ *
+ * @param skip The frame not to extract or LRUL_NONE.
+ * @retval The index of the frame.
+ */
+extern unsigned wtlfu_rm(struct wtlfu *wtlfu, unsigned skip);
+
+/** Remove a specific frame. */
+extern void wtlfu_rm_item(struct wtlfu *wtlfu, unsigned idx);
+
+/**
+ * Get the frames from the main segment victim to the most recently used
+ * frame of the window.
+ *
+ * Adding the frames in this order to a new W-TinyLFU keeps their recency,
+ * not their frequencies and segments.
+ *
+ * @param idxs The frame indexes, up to n.
+ * @param n The number of frames added.
+ */
+extern void wtlfu_order(struct wtlfu *wtlfu, unsigned *idxs, unsigned n);
+
+#endif /* WTLFU_H */
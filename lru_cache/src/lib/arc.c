@@ -0,0 +1,260 @@
+/**
+ * @file
+ * Adaptive replacement cache policy for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "lru_cache/log.h"
+#include "lru_cache/mem.h"
+#include "lru_cache/lrul.h"
+#include "lru_cache/arc.h"
+
+/*
+ * Megiddo, Modha, ARC: A Self-Tuning, Low Overhead Replacement Cache.
+ *
+ * Frames of keys accessed once are on the recency list T1, frames hit or
+ * added again after an eviction are on the frequency list T2. A frame is
+ * reused from T1 if it is larger than the target size p, from T2
+ * otherwise.
+ *
+ * Keys evicted from T1 and T2 are remembered on the ghost lists B1 and
+ * B2. A put of a key on B1 means T1 is too small, so it grows p, a put of
+ * a key on B2 shrinks p. So, p follows the workload between recency and
+ * frequency. There are up to capacity ghosts, with T1 and B1 up to
+ * capacity together.
+ *
+ * A ghost is a hash of a key on a chain of a hash table and on an lrul
+ * list, 20 bytes or so with no key bytes. The unused ghosts are on a list
+ * of their own. Keys are told apart by their hashes, so a hash collision
+ * at most adapts p by mistake.
+ *
+ * p adapts as the key is added, so the frame the key reuses is chosen by
+ * p before the adaption.
+ */
+enum arc_list {
+    ARC_T1 = 0,
+    ARC_T2,
+    ARC_N_LISTS,
+};
+
+enum arc_ghost_list {
+    ARC_B1 = 0,
+    ARC_B2,
+    /** The unused ghosts. */
+    ARC_FREE,
+    ARC_N_GHOST_LISTS,
+};
+
+struct arc {
+    struct lrul *lists;
+    /** The key hashes of the frames. */
+    unsigned *hashes;
+    /** The lists of the frames. */
+    unsigned char *segs;
+    unsigned n[ARC_N_LISTS];
+    struct lrul *ghosts;
+    unsigned *ghost_hashes;
+    /** The next ghost on the chain of the hash table. */
+    unsigned *ghost_next;
+    unsigned char *ghost_segs;
+    unsigned n_ghosts[ARC_N_LISTS];
+    /** The chains of ghosts by hash. */
+    unsigned *buckets;
+    unsigned bucket_mask;
+    /** The target size of T1. */
+    unsigned target;
+    unsigned capacity;
+    struct mem_attr mem;
+};
+
+static size_t arc_n_buckets(struct arc *arc)
+{
+    return (size_t) arc->bucket_mask + 1;
+}
+
+struct arc *arc_alloc(unsigned capacity, struct mem_attr const *mem)
+{
+    struct arc *arc = calloc(1, sizeof(*arc));
+    unsigned n_buckets = 1;
+    unsigned i;
+
+    die_on(!arc, "failed to allocate ARC\n");
+
+    if (mem)
+        arc->mem = *mem;
+
+    while (n_buckets < capacity)
+        n_buckets <<= 1;
+
+    arc->capacity = capacity;
+    arc->bucket_mask = n_buckets - 1;
+    arc->lists = lrul_alloc(capacity, ARC_N_LISTS, &arc->mem);
+    arc->hashes = mem_alloc(capacity * sizeof(*arc->hashes), &arc->mem);
+    arc->segs = mem_alloc(capacity * sizeof(*arc->segs), &arc->mem);
+    arc->ghosts = lrul_alloc(capacity, ARC_N_GHOST_LISTS, &arc->mem);
+    arc->ghost_hashes = mem_alloc(capacity * sizeof(*arc->ghost_hashes),
+                                  &arc->mem);
+    arc->ghost_next = mem_alloc(capacity * sizeof(*arc->ghost_next),
+                                &arc->mem);
+    arc->ghost_segs = mem_alloc(capacity * sizeof(*arc->ghost_segs),
+                                &arc->mem);
+    arc->buckets = mem_alloc(arc_n_buckets(arc) * sizeof(*arc->buckets),
+                             &arc->mem);
+    memset(arc->buckets, 0xff, arc_n_buckets(arc) * sizeof(*arc->buckets));
+
+    for (i = 0; i < capacity; ++i)
+        lrul_add(arc->ghosts, ARC_FREE, i);
+
+    return arc;
+}
+
+void arc_free(struct arc *arc)
+{
+    unsigned capacity = arc->capacity;
+
+    mem_free(arc->buckets, arc_n_buckets(arc) * sizeof(*arc->buckets),
+             &arc->mem);
+    mem_free(arc->ghost_segs, capacity * sizeof(*arc->ghost_segs),
+             &arc->mem);
+    mem_free(arc->ghost_next, capacity * sizeof(*arc->ghost_next),
+             &arc->mem);
+    mem_free(arc->ghost_hashes, capacity * sizeof(*arc->ghost_hashes),
+             &arc->mem);
+    lrul_free(arc->ghosts);
+    mem_free(arc->segs, capacity * sizeof(*arc->segs), &arc->mem);
+    mem_free(arc->hashes, capacity * sizeof(*arc->hashes), &arc->mem);
+    lrul_free(arc->lists);
+    free(arc);
+}
+
+static unsigned *arc_bucket(struct arc *arc, unsigned hash)
+{
+    return arc->buckets + (hash & arc->bucket_mask);
+}
+
+static unsigned arc_ghost_find(struct arc *arc, unsigned hash)
+{
+    unsigned g = *arc_bucket(arc, hash);
+
+    while (g != LRUL_NONE && arc->ghost_hashes[g] != hash)
+        g = arc->ghost_next[g];
+
+    return g;
+}
+
+/* Forget a ghost. */
+static void arc_ghost_rm(struct arc *arc, unsigned g)
+{
+    unsigned *p = arc_bucket(arc, arc->ghost_hashes[g]);
+
+    while (*p != g)
+        p = arc->ghost_next + *p;
+    *p = arc->ghost_next[g];
+
+    lrul_rm_item(arc->ghosts, g);
+    --arc->n_ghosts[arc->ghost_segs[g]];
+    lrul_add(arc->ghosts, ARC_FREE, g);
+}
+
+/* Remember a key evicted from T1 on B1 or from T2 on B2. */
+static void arc_ghost_add(struct arc *arc, unsigned list, unsigned hash)
+{
+    unsigned *bucket = arc_bucket(arc, hash);
+    unsigned g;
+
+    if (arc->n[ARC_T1] + arc->n_ghosts[ARC_B1] >= arc->capacity &&
+        arc->n_ghosts[ARC_B1])
+        arc_ghost_rm(arc, lrul_tail(arc->ghosts, ARC_B1));
+
+    if (arc->n_ghosts[ARC_B1] + arc->n_ghosts[ARC_B2] == arc->capacity)
+        arc_ghost_rm(arc, lrul_tail(arc->ghosts, arc->n_ghosts[ARC_B2] ?
+                                                 ARC_B2 : ARC_B1));
+
+    g = lrul_rm(arc->ghosts, ARC_FREE);
+    arc->ghost_hashes[g] = hash;
+    arc->ghost_next[g] = *bucket;
+    *bucket = g;
+    arc->ghost_segs[g] = list;
+    ++arc->n_ghosts[list];
+    lrul_add(arc->ghosts, list, g);
+}
+
+static void arc_push(struct arc *arc, unsigned list, unsigned idx)
+{
+    lrul_add(arc->lists, list, idx);
+    arc->segs[idx] = list;
+    ++arc->n[list];
+}
+
+void arc_add(struct arc *arc, unsigned idx, unsigned hash)
+{
+    unsigned g = arc_ghost_find(arc, hash);
+    unsigned b1 = arc->n_ghosts[ARC_B1];
+    unsigned b2 = arc->n_ghosts[ARC_B2];
+    unsigned delta;
+
+    arc->hashes[idx] = hash;
+
+    if (g == LRUL_NONE) {
+        arc_push(arc, ARC_T1, idx);
+        return;
+    }
+
+    if (arc->ghost_segs[g] == ARC_B1) {
+        delta = b1 >= b2 ? 1 : b2 / b1;
+        arc->target = arc->capacity - arc->target > delta ?
+                      arc->target + delta : arc->capacity;
+    } else {
+        delta = b2 >= b1 ? 1 : b1 / b2;
+        arc->target = arc->target > delta ? arc->target - delta : 0;
+    }
+
+    arc_ghost_rm(arc, g);
+    arc_push(arc, ARC_T2, idx);
+}
+
+void arc_hit(struct arc *arc, unsigned idx)
+{
+    arc_rm_item(arc, idx);
+    arc_push(arc, ARC_T2, idx);
+}
+
+unsigned arc_rm(struct arc *arc, unsigned skip)
+{
+    unsigned list = ARC_T2;
+    unsigned idx;
+
+    if (arc->n[ARC_T1] && (arc->n[ARC_T1] > arc->target || !arc->n[ARC_T2]))
+        list = ARC_T1;
+
+    idx = lrul_tail_skip(arc->lists, list, skip);
+    if (idx == LRUL_NONE) {
+        list = list == ARC_T1 ? ARC_T2 : ARC_T1;
+        idx = lrul_tail_skip(arc->lists, list, skip);
+    }
+
+    ASSERT(idx != LRUL_NONE);
+
+    arc_rm_item(arc, idx);
+    arc_ghost_add(arc, list == ARC_T1 ? ARC_B1 : ARC_B2, arc->hashes[idx]);
+
+    return idx;
+}
+
+void arc_rm_item(struct arc *arc, unsigned idx)
+{
+    lrul_rm_item(arc->lists, idx);
+    --arc->n[arc->segs[idx]];
+}
+
+void arc_order(struct arc *arc, unsigned *idxs, unsigned n)
+{
+    ASSERT(n == arc->n[ARC_T1] + arc->n[ARC_T2]);
+    (void) n;
+
+    lrul_order(arc->lists, ARC_T1, idxs, arc->n[ARC_T1]);
+    lrul_order(arc->lists, ARC_T2, idxs + arc->n[ARC_T1], arc->n[ARC_T2]);
+}
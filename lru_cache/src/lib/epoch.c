@@ -0,0 +1,165 @@
+/**
+ * @file
+ * Epoch based reclamation for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "lru_cache/log.h"
+#include "lru_cache/epoch.h"
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+/*
+ * Every thread reading in a section has a record with the epoch it has
+ * entered the section in. The global epoch is advanced only if all the
+ * readers are in it, so a reader is at most one epoch behind, and memory
+ * retired in an epoch e is not reachable once the epoch is e + 2.
+ *
+ * The records are never freed: a record of a thread exited is reused by
+ * another thread, so the list of records only grows to the maximum number
+ * of threads reading at once.
+ */
+struct epoch_rec {
+    /** The epoch of the read section or 0 out of one. */
+    uint64_t active;
+    struct epoch_rec *next;
+    /** The depth of the nested read sections. */
+    unsigned depth;
+    /** The record belongs to a thread. */
+    int used;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static uint64_t epoch_global = 1;
+static struct epoch_rec *epoch_recs;
+static pthread_key_t epoch_key;
+static pthread_once_t epoch_once = PTHREAD_ONCE_INIT;
+static __thread struct epoch_rec *epoch_self;
+
+static void epoch_release(void *arg)
+{
+    struct epoch_rec *rec = arg;
+
+    rec->depth = 0;
+    __atomic_store_n(&rec->active, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&rec->used, 0, __ATOMIC_RELEASE);
+}
+
+static void epoch_init(void)
+{
+    int rc = pthread_key_create(&epoch_key, epoch_release);
+
+    die_on(rc, "failed to create epoch key: %d\n", rc);
+}
+
+static struct epoch_rec *epoch_register(void)
+{
+    struct epoch_rec *rec;
+    int used = 0;
+    int rc;
+
+    pthread_once(&epoch_once, epoch_init);
+
+    for (rec = __atomic_load_n(&epoch_recs, __ATOMIC_ACQUIRE); rec;
+         rec = rec->next) {
+        if (!__atomic_load_n(&rec->used, __ATOMIC_RELAXED) &&
+            __atomic_compare_exchange_n(&rec->used, &used, 1, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+        used = 0;
+    }
+
+    if (!rec) {
+        rc = posix_memalign((void **) &rec, CACHE_LINE_SIZE, sizeof(*rec));
+        die_on(rc, "failed to allocate epoch record\n");
+        rec->active = 0;
+        rec->depth = 0;
+        rec->used = 1;
+        rec->next = __atomic_load_n(&epoch_recs, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&epoch_recs, &rec->next, rec, 1,
+                                            __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED))
+            ;
+    }
+
+    rc = pthread_setspecific(epoch_key, rec);
+    die_on(rc, "failed to set epoch record: %d\n", rc);
+    epoch_self = rec;
+
+    return rec;
+}
+
+void epoch_enter(void)
+{
+    struct epoch_rec *rec = epoch_self;
+
+    if (!rec)
+        rec = epoch_register();
+
+    if (rec->depth++)
+        return;
+
+    /*
+     * The record is published before the reads of the section, so a
+     * thread advancing the epoch either sees it or retires memory the
+     * section cannot reach.
+     */
+    __atomic_store_n(&rec->active,
+                     __atomic_load_n(&epoch_global, __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void epoch_exit(void)
+{
+    struct epoch_rec *rec = epoch_self;
+
+    ASSERT(rec && rec->depth);
+
+    if (!--rec->depth)
+        __atomic_store_n(&rec->active, 0, __ATOMIC_RELEASE);
+}
+
+uint64_t epoch_now(void)
+{
+    return __atomic_load_n(&epoch_global, __ATOMIC_ACQUIRE);
+}
+
+uint64_t epoch_advance(void)
+{
+    struct epoch_rec *rec;
+    uint64_t epoch;
+    uint64_t active;
+
+    /* Memory retired is unreachable before the records are read. */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    epoch = __atomic_load_n(&epoch_global, __ATOMIC_ACQUIRE);
+
+    for (rec = __atomic_load_n(&epoch_recs, __ATOMIC_ACQUIRE); rec;
+         rec = rec->next) {
+        active = __atomic_load_n(&rec->active, __ATOMIC_ACQUIRE);
+        if (active && active != epoch)
+            return epoch;
+    }
+
+    /* The epoch is advanced by another thread if the exchange fails. */
+    __atomic_compare_exchange_n(&epoch_global, &epoch, epoch + 1, 0,
+                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(&epoch_global, __ATOMIC_ACQUIRE);
+}
+
+void epoch_synchronize(void)
+{
+    uint64_t epoch = epoch_now() + EPOCH_GRACE;
+
+    ASSERT(!epoch_self || !epoch_self->depth);
+
+    while (epoch_advance() < epoch)
+        sched_yield();
+}
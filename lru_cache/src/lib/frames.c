@@ -5,54 +5,376 @@
  * @author Boris Stankevich <microsoft-wanted@yandex.ru>
  * @copyright GPL-3.0+
  */
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "lru_cache/log.h"
+#include "lru_cache/mem.h"
+#include "lru_cache/slab.h"
+#include "lru_cache/epoch.h"
 #include "lru_cache/frames.h"
 
+/*
+ * The key and the value of a frame are kept together in a chunk of the
+ * slab owned by the frames: the lengths are followed by the key bytes and
+ * the value bytes. A frame points to its chunk only, so the chunk is
+ * switched with a single store.
+ *
+ * Frames within [0, size) are used unless they are on the free list. A
+ * free frame keeps no data.
+ *
+ * With deferred release, a chunk is never changed once it is published,
+ * and a chunk released is retired in the epoch of the release. It is put
+ * back to the slab by frames_reclaim() once no reader can reach it.
+ */
+#define FRAMES_NONE (~0U)
+
+/* The chunks retired are reclaimed in batches of this many at least. */
+#define FRAMES_RECLAIM_BATCH 64U
+
+struct frame_data {
+    unsigned key_len;
+    unsigned value_len;
+    char bytes[];
+};
+
+struct frame {
+    struct frame_data *data;
+    /** The next free frame for a free frame. */
+    unsigned next;
+};
+
+struct frame_retired {
+    struct frame_data *data;
+    uint64_t epoch;
+};
+
 struct frames {
-    int *values;
+    struct frame *frames;
+    struct slab *slab;
     unsigned capacity;
     unsigned size;
+    /** The free list of frames released within [0, size). */
+    unsigned free;
+    unsigned n_free;
+    /** Chunks released are retired, in the order of their epochs. */
+    int defer;
+    struct frame_retired *retired;
+    unsigned n_retired;
+    unsigned retired_cap;
+    /** The number of chunks retired to try to reclaim them at. */
+    unsigned reclaim_at;
+    struct mem_attr mem;
 };
 
-struct frames *frames_alloc(unsigned capacity)
+struct frames *frames_alloc(unsigned capacity, struct mem_attr const *mem)
 {
     struct frames *frames;
 
     ASSERT(capacity > 0);
 
-    frames = malloc(sizeof(*frames));
+    frames = calloc(1, sizeof(*frames));
     die_on(!frames, "failed to allocate frames: capacity %u\n", capacity);
 
-    frames->values = malloc(capacity * sizeof(frames->values[0]));
-    die_on(!frames, "failed to allocate frames: capacity %u\n", capacity);
+    if (mem)
+        frames->mem = *mem;
+
+    /* Readers without locks may reach any frame, even an unused one. */
+    frames->frames = mem_alloc(capacity * sizeof(frames->frames[0]),
+                               &frames->mem);
+    memset(frames->frames, 0, capacity * sizeof(frames->frames[0]));
+    frames->slab = slab_alloc(&frames->mem);
     frames->capacity = capacity;
     frames->size = 0;
+    frames->free = FRAMES_NONE;
+    frames->n_free = 0;
+    frames->reclaim_at = FRAMES_RECLAIM_BATCH;
 
     return frames;
 }
 
+void frames_defer(struct frames *frames)
+{
+    frames->defer = 1;
+}
+
+static unsigned frames_chunk_len(unsigned key_len, unsigned value_len)
+{
+    return sizeof(struct frame_data) + key_len + value_len;
+}
+
+static void frames_put_data(struct frames *frames, struct frame_data *data)
+{
+    slab_put(frames->slab, data,
+             frames_chunk_len(data->key_len, data->value_len));
+}
+
+static void frames_release(struct frames *frames, struct frame_data *data)
+{
+    struct frame_retired *retired;
+
+    if (!data)
+        return;
+
+    if (!frames->defer) {
+        frames_put_data(frames, data);
+        return;
+    }
+
+    if (frames->n_retired == frames->retired_cap) {
+        frames->retired_cap = frames->retired_cap ?
+                              frames->retired_cap * 2 : FRAMES_RECLAIM_BATCH;
+        retired = realloc(frames->retired,
+                          frames->retired_cap * sizeof(*retired));
+        die_on(!retired, "failed to allocate retired frames: %u\n",
+               frames->retired_cap);
+        frames->retired = retired;
+    }
+
+    retired = frames->retired + frames->n_retired++;
+    retired->data = data;
+    retired->epoch = epoch_now();
+}
+
+void frames_reclaim(struct frames *frames)
+{
+    uint64_t epoch;
+    unsigned i;
+
+    if (frames->n_retired < frames->reclaim_at)
+        return;
+
+    epoch = epoch_advance();
+    for (i = 0; i < frames->n_retired &&
+                frames->retired[i].epoch + EPOCH_GRACE <= epoch; ++i)
+        frames_put_data(frames, frames->retired[i].data);
+
+    frames->n_retired -= i;
+    memmove(frames->retired, frames->retired + i,
+            frames->n_retired * sizeof(*frames->retired));
+    frames->reclaim_at = frames->n_retired + FRAMES_RECLAIM_BATCH;
+}
+
 void frames_free(struct frames *frames)
 {
-    free(frames->values);
+    unsigned i;
+
+    for (i = 0; i < frames->size; ++i)
+        frames_release(frames, frames->frames[i].data);
+
+    /* No reader is left once the frames are freed. */
+    for (i = 0; i < frames->n_retired; ++i)
+        frames_put_data(frames, frames->retired[i].data);
+
+    free(frames->retired);
+    slab_free(frames->slab);
+    mem_free(frames->frames, frames->capacity * sizeof(frames->frames[0]),
+             &frames->mem);
     free(frames);
 }
 
+void frames_resize(struct frames *frames, unsigned capacity,
+                   unsigned const *idxs, unsigned n, unsigned *to)
+{
+    unsigned size = frames->size < capacity ? frames->size : capacity;
+    unsigned unused = 0;
+    struct frame *f;
+    unsigned i;
+
+    ASSERT(n <= capacity && n == frames_used(frames));
+
+    f = mem_alloc(capacity * sizeof(*f), &frames->mem);
+    memcpy(f, frames->frames, size * sizeof(*f));
+    memset(f + size, 0, (capacity - size) * sizeof(*f));
+
+    /* A free frame keeps no data, so the frames moved take the first. */
+    for (i = 0; i < n; ++i) {
+        to[i] = idxs[i];
+        if (idxs[i] < capacity)
+            continue;
+
+        while (f[unused].data)
+            ++unused;
+        f[unused].data = frames->frames[idxs[i]].data;
+        to[i] = unused++;
+    }
+
+    frames->free = FRAMES_NONE;
+    frames->n_free = 0;
+    for (i = size; i--;) {
+        if (f[i].data)
+            continue;
+        f[i].next = frames->free;
+        frames->free = i;
+        ++frames->n_free;
+    }
+
+    mem_free(frames->frames, frames->capacity * sizeof(frames->frames[0]),
+             &frames->mem);
+    frames->frames = f;
+    frames->capacity = capacity;
+    frames->size = size;
+}
+
 int frames_all_used(struct frames *frames)
 {
-    return frames->size == frames->capacity;
+    return frames->size == frames->capacity && !frames->n_free;
+}
+
+unsigned frames_used(struct frames *frames)
+{
+    return frames->size - frames->n_free;
+}
+
+unsigned frames_data_size(unsigned key_len, unsigned value_len)
+{
+    return slab_chunk_size(frames_chunk_len(key_len, value_len));
 }
 
 unsigned frames_reserve(struct frames *frames)
 {
-    ASSERT(frames->size < frames->capacity);
+    unsigned idx;
+
+    if (frames->n_free) {
+        idx = frames->free;
+        frames->free = frames->frames[idx].next;
+        --frames->n_free;
+    } else {
+        ASSERT(frames->size < frames->capacity);
+        idx = frames->size++;
+    }
 
-    return frames->size++;
+    return idx;
 }
 
-int *frames_ref(struct frames *frames, unsigned idx)
+/* Publish the chunk of a frame to readers without locks. */
+static void frames_publish(struct frame *frame, struct frame_data *data)
 {
+    __atomic_store_n(&frame->data, data, __ATOMIC_RELEASE);
+}
+
+void frames_rm(struct frames *frames, unsigned idx)
+{
+    struct frame *frame = frames->frames + idx;
+    struct frame_data *data = frame->data;
+
+    ASSERT(idx < frames->size);
+
+    frames_publish(frame, NULL);
+    frames_release(frames, data);
+
+    frame->next = frames->free;
+    frames->free = idx;
+    ++frames->n_free;
+}
+
+void frames_set(struct frames *frames, unsigned idx,
+                void const *key, unsigned key_len,
+                void const *value, unsigned value_len)
+{
+    struct frame *frame = frames->frames + idx;
+    struct frame_data *old = frame->data;
+    struct frame_data *data;
+
+    ASSERT(idx < frames->size);
+
+    data = slab_get(frames->slab, frames_chunk_len(key_len, value_len));
+    data->key_len = key_len;
+    data->value_len = value_len;
+    memcpy(data->bytes, key, key_len);
+    memcpy(data->bytes + key_len, value, value_len);
+
+    frames_publish(frame, data);
+    frames_release(frames, old);
+}
+
+void frames_set_value(struct frames *frames, unsigned idx,
+                      void const *value, unsigned value_len)
+{
+    struct frame *frame = frames->frames + idx;
+    struct frame_data *old = frame->data;
+    struct frame_data *data;
+
+    ASSERT(idx < frames->size && old);
+
+    /* Keep the chunk if the new value fits it and no reader sees it. */
+    if (!frames->defer &&
+        slab_chunk_size(frames_chunk_len(old->key_len, old->value_len)) ==
+        slab_chunk_size(frames_chunk_len(old->key_len, value_len))) {
+        old->value_len = value_len;
+        memcpy(old->bytes + old->key_len, value, value_len);
+        return;
+    }
+
+    data = slab_get(frames->slab, frames_chunk_len(old->key_len, value_len));
+    data->key_len = old->key_len;
+    data->value_len = value_len;
+    memcpy(data->bytes, old->bytes, old->key_len);
+    memcpy(data->bytes + old->key_len, value, value_len);
+
+    frames_publish(frame, data);
+    frames_release(frames, old);
+}
+
+void const *frames_key(struct frames *frames, unsigned idx, unsigned *len)
+{
+    struct frame_data *data = frames->frames[idx].data;
+
     ASSERT(idx < frames->size);
 
-    return frames->values + idx;
+    *len = data->key_len;
+
+    return data->bytes;
+}
+
+void const *frames_value(struct frames *frames, unsigned idx, unsigned *len)
+{
+    struct frame_data *data = frames->frames[idx].data;
+
+    ASSERT(idx < frames->size);
+
+    *len = data->value_len;
+
+    return data->bytes + data->key_len;
+}
+
+void const *frames_data(struct frames *frames, unsigned idx)
+{
+    ASSERT(idx < frames->capacity);
+
+    return __atomic_load_n(&frames->frames[idx].data, __ATOMIC_ACQUIRE);
+}
+
+int frames_data_key_eq(void const *data, void const *key, unsigned key_len)
+{
+    struct frame_data const *fd = data;
+
+    return fd->key_len == key_len && !memcmp(fd->bytes, key, key_len);
+}
+
+void const *frames_data_value(void const *data, unsigned *len)
+{
+    struct frame_data const *fd = data;
+
+    *len = fd->value_len;
+
+    return fd->bytes + fd->key_len;
+}
+
+int frames_key_eq(struct frames *frames, unsigned idx,
+                  void const *key, unsigned key_len)
+{
+    void const *data = frames_data(frames, idx);
+
+    return data && frames_data_key_eq(data, key, key_len);
+}
+
+void frames_prefetch(struct frames *frames, unsigned idx)
+{
+    __builtin_prefetch(frames->frames + idx);
+}
+
+void frames_prefetch_data(struct frames *frames, unsigned idx)
+{
+    __builtin_prefetch(frames->frames[idx].data);
 }
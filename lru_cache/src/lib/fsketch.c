@@ -0,0 +1,139 @@
+/**
+ * @file
+ * Frequency sketch for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lru_cache/log.h"
+#include "lru_cache/mem.h"
+#include "lru_cache/fsketch.h"
+
+/*
+ * A count-min sketch of 4-bit counters, 16 to a word. A key has a counter
+ * in each of FSKETCH_DEPTH rows picked by its hash multiplied by the seed
+ * of the row, and its frequency is the least of them. Only the least
+ * counters are incremented, which keeps the others from growing by the
+ * accesses of colliding keys.
+ *
+ * There are 4 counters per key cached in every row, 2 bytes per key.
+ */
+#define FSKETCH_DEPTH 4U
+#define FSKETCH_MAX 15U
+#define FSKETCH_HALF 0x7777777777777777ULL
+
+struct fsketch {
+    uint64_t *table;
+    /** The mask of the word index of a row. */
+    unsigned mask;
+    unsigned n_adds;
+    /** The number of adds to halve the counters at. */
+    unsigned sample;
+    struct mem_attr mem;
+};
+
+static uint64_t const fsketch_seeds[FSKETCH_DEPTH] = {
+    0xc3a5c85c97cb3127ULL,
+    0xb492b66fbe98f273ULL,
+    0x9ae16a3b2f90404fULL,
+    0x9e3779b97f4a7c15ULL,
+};
+
+static size_t fsketch_size(struct fsketch *fs)
+{
+    return FSKETCH_DEPTH * ((size_t) fs->mask + 1) * sizeof(*fs->table);
+}
+
+struct fsketch *fsketch_alloc(unsigned capacity, struct mem_attr const *mem)
+{
+    struct fsketch *fs = calloc(1, sizeof(*fs));
+    unsigned words = 1;
+
+    die_on(!fs, "failed to allocate frequency sketch\n");
+
+    if (mem)
+        fs->mem = *mem;
+
+    while (words < capacity / 4U)
+        words <<= 1;
+
+    fs->mask = words - 1;
+    fs->sample = capacity < ~0U / 10U ? capacity * 10U : ~0U;
+    fs->table = mem_alloc(fsketch_size(fs), &fs->mem);
+    memset(fs->table, 0, fsketch_size(fs));
+
+    return fs;
+}
+
+void fsketch_free(struct fsketch *fs)
+{
+    mem_free(fs->table, fsketch_size(fs), &fs->mem);
+    free(fs);
+}
+
+/*
+ * Get the word of the counter of a key in a row and the shift of the
+ * counter within the word.
+ */
+static uint64_t *fsketch_counter(struct fsketch *fs, unsigned hash,
+                                 unsigned row, unsigned *shift)
+{
+    uint64_t h = (hash + 1ULL) * fsketch_seeds[row];
+
+    *shift = (h >> 28 & 15U) * 4U;
+
+    return fs->table + (size_t) row * (fs->mask + 1U) + (h >> 32 & fs->mask);
+}
+
+unsigned fsketch_estimate(struct fsketch *fs, unsigned hash)
+{
+    unsigned min = FSKETCH_MAX;
+    uint64_t *word;
+    unsigned shift;
+    unsigned c;
+    unsigned i;
+
+    for (i = 0; i < FSKETCH_DEPTH; ++i) {
+        word = fsketch_counter(fs, hash, i, &shift);
+        c = *word >> shift & FSKETCH_MAX;
+        if (c < min)
+            min = c;
+    }
+
+    return min;
+}
+
+/* Halve all counters, the odd ones lose the half. */
+static void fsketch_age(struct fsketch *fs)
+{
+    size_t n = FSKETCH_DEPTH * ((size_t) fs->mask + 1);
+    size_t i;
+
+    for (i = 0; i < n; ++i)
+        fs->table[i] = fs->table[i] >> 1 & FSKETCH_HALF;
+
+    fs->n_adds /= 2;
+}
+
+void fsketch_add(struct fsketch *fs, unsigned hash)
+{
+    unsigned min = fsketch_estimate(fs, hash);
+    uint64_t *word;
+    unsigned shift;
+    unsigned i;
+
+    if (min == FSKETCH_MAX)
+        return;
+
+    for (i = 0; i < FSKETCH_DEPTH; ++i) {
+        word = fsketch_counter(fs, hash, i, &shift);
+        if ((*word >> shift & FSKETCH_MAX) == min)
+            *word += 1ULL << shift;
+    }
+
+    if (++fs->n_adds >= fs->sample)
+        fsketch_age(fs);
+}
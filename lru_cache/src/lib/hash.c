@@ -0,0 +1,147 @@
+/**
+ * @file
+ * Key hashing for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <string.h>
+#include <time.h>
+#include <sys/random.h>
+#include "lru_cache/hash.h"
+
+/*
+ * The hash follows wyhash: the key is read by 8 byte words, and words are
+ * mixed by pairs with a 64x64->128 bit multiplication whose halves are
+ * folded together. The secrets are the wyhash ones.
+ */
+static uint64_t const hash_secret[4] = {
+    0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL,
+    0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL,
+};
+
+static void hash_mum128(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t) *a * *b;
+
+    *a = (uint64_t) r;
+    *b = (uint64_t) (r >> 64);
+#else
+    uint64_t ha = *a >> 32, la = (uint32_t) *a;
+    uint64_t hb = *b >> 32, lb = (uint32_t) *b;
+    uint64_t hh = ha * hb, hl = ha * lb, lh = la * hb, ll = la * lb;
+    uint64_t t = ll + (hl << 32);
+    uint64_t lo = t + (lh << 32);
+    uint64_t c = (t < ll) + (lo < t);
+
+    *a = lo;
+    *b = hh + (hl >> 32) + (lh >> 32) + c;
+#endif
+}
+
+static uint64_t hash_mum(uint64_t a, uint64_t b)
+{
+    hash_mum128(&a, &b);
+
+    return a ^ b;
+}
+
+static uint64_t hash_read8(unsigned char const *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+static uint64_t hash_read4(unsigned char const *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+/* Read 1 to 3 bytes. */
+static uint64_t hash_read3(unsigned char const *p, unsigned len)
+{
+    return ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8) |
+           p[len - 1];
+}
+
+unsigned hash_bytes(void const *key, unsigned len, uint64_t seed)
+{
+    unsigned char const *p = key;
+    uint64_t const *s = hash_secret;
+    uint64_t see1, see2;
+    uint64_t a, b;
+    unsigned i;
+
+    seed ^= hash_mum(seed ^ s[0], s[1]);
+
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (hash_read4(p) << 32) | hash_read4(p + ((len >> 3) << 2));
+            b = (hash_read4(p + len - 4) << 32) |
+                hash_read4(p + len - 4 - ((len >> 3) << 2));
+        } else if (len) {
+            a = hash_read3(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        i = len;
+        if (i > 48) {
+            see1 = seed;
+            see2 = seed;
+            do {
+                seed = hash_mum(hash_read8(p) ^ s[1],
+                                hash_read8(p + 8) ^ seed);
+                see1 = hash_mum(hash_read8(p + 16) ^ s[2],
+                                hash_read8(p + 24) ^ see1);
+                see2 = hash_mum(hash_read8(p + 32) ^ s[3],
+                                hash_read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+
+        while (i > 16) {
+            seed = hash_mum(hash_read8(p) ^ s[1], hash_read8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+
+        a = hash_read8(p + i - 16);
+        b = hash_read8(p + i - 8);
+    }
+
+    a ^= s[1];
+    b ^= seed;
+    hash_mum128(&a, &b);
+    a = hash_mum(a ^ s[0] ^ len, b ^ s[1]);
+
+    return (unsigned) (a ^ (a >> 32));
+}
+
+uint64_t hash_seed(void)
+{
+    static uint64_t counter;
+    struct timespec ts;
+    uint64_t seed;
+
+    if (getrandom(&seed, sizeof(seed), GRND_NONBLOCK) != sizeof(seed)) {
+        /* No entropy yet, seeds still differ between caches. */
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        seed = hash_mum((uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec,
+                        __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED) ^
+                        (uintptr_t) &seed);
+    }
+
+    return seed ? seed : hash_secret[0];
+}
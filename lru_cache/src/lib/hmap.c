@@ -6,8 +6,14 @@
  * @copyright GPL-3.0+
  */
 #include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 #include "lru_cache/log.h"
+#include "lru_cache/epoch.h"
 #include "lru_cache/frames.h"
+#include "lru_cache/mem.h"
 #include "lru_cache/hmap.h"
 
 #ifndef UNUSED
@@ -18,150 +24,517 @@
 #define UINT_WIDTH 32
 #endif
 
+/* ThreadSanitizer checks the group matches of the scalar code only. */
+#if defined(__SANITIZE_THREAD__)
+#define HMAP_SCALAR 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define HMAP_SCALAR 1
+#endif
+#endif
+
+#if defined(__SSE2__) && !defined(HMAP_SCALAR)
+#define HMAP_SSE2 1
+#endif
+
+#if defined(HMAP_SSE2) && defined(__x86_64__)
+#define HMAP_AVX2 1
+#endif
+
 /*
- * Maximum number of bits in the number of buckets.
+ * The map is an open addressing table probed by groups of slots.
+ *
+ * The number of slots is derived from the number of frames so that the
+ * table is never more than half full:
+ *   Number of slots = MAX(1 << (FLS(Number of frames) + 1),
+ *                         HMAP_GROUP_MAX)
+ *
+ * Every slot has a control byte: a 7-bit tag of the key hash for a used
+ * slot or HMAP_EMPTY/HMAP_DELETED otherwise. A lookup matches the tag
+ * against a group of control bytes at once with SSE2 (16 slots) or AVX2
+ * (32 slots), and reads the slots of the tag hits only. The key of a
+ * frame is compared only if the slot keeps the same hash. It stops at the
+ * first group with an empty slot. The control bytes of the first
+ * HMAP_GROUP_MAX slots are mirrored past the end, so a group is always
+ * loaded with one unaligned load.
+ *
+ * A key is added to the first unused slot from its home slot. A removed
+ * slot becomes empty unless it is within a run of HMAP_GROUP_MIN used
+ * slots, a lookup might have not stopped at such a run, so the slot is
+ * marked deleted instead. Deleted slots are reused by additions.
  *
- * The number of buckets is derived from the number of frames:
- *   Number of buckets = MIN(1 << FLS(Number of frames),
- *                           1 << HMAP_BUCKETS_BITS)
+ * Once there are few empty slots left, the deleted slots are dropped by
+ * moving the keys to another table of the same size. The keys are moved
+ * incrementally: every addition and removal moves the keys of the next
+ * HMAP_MIGRATE_SLOTS slots of the old table, and a lookup probes both
+ * tables until the old one is drained. So no operation walks the table,
+ * an addition or a removal places HMAP_MIGRATE_SLOTS + 1 keys at most.
+ * The slots moved are marked deleted, so a lookup of a key left in the
+ * old table still probes past them.
+ *
+ * The table has at least twice as many slots as frames, so at least 3/8
+ * of the slots are added to before the next table is full enough to move
+ * again, while the old table is drained within 1/16 of the slots added.
+ * Once drained, the control bytes of the old table are cleared by
+ * HMAP_CLEAR_BYTES per change, so it is ready for the next move. The two
+ * tables are allocated at once and take turns, so they are not freed
+ * while lookups without locks may read them.
+ *
+ * A resize moves the keys the same way to a table sized for the new
+ * number of frames. A larger old table moves as many more slots per
+ * change as it is larger, so it is drained within 1/16 of the slots added
+ * too. Once drained, it is retired to the epoch of the drain and freed
+ * once no lookup can read it, and a table of the new size takes its turn.
+ *
+ * The map does not allocate per frame: a slot keeps the key hash and the
+ * index of the frame, and the slot of the frame i and its table are
+ * tracked in hmap_idx[i].
+ *
+ * A lookup may race with changes of the map: it reads frame indexes of
+ * frames that exist, but it may return the frame of a key changed since or
+ * miss a key moved by a rehash. Such a caller checks the frame found and
+ * looks up again if the map has changed.
+ *
+ * For such lookups, the control bytes and the slot fields are written
+ * with relaxed atomic stores and read with relaxed atomic loads, so a
+ * lookup reads every one of them either before or after a change. A group
+ * loaded with SSE2 or AVX2 is not one atomic load, but the bytes it reads
+ * are stored one by one, so every byte of the group is such a value too.
+ * The changes read the map with plain loads, as they are serialized.
+ */
+
+#define HMAP_GROUP_MIN 16U
+#define HMAP_GROUP_MAX 32U
+
+/** The number of slots of the old table to move per change of the map. */
+#define HMAP_MIGRATE_SLOTS 16U
+
+/** The number of control bytes of the other table to clear per change. */
+#define HMAP_CLEAR_BYTES 1024U
+
+/** The number of changes to try to free a table retired at. */
+#define HMAP_RECLAIM_STEPS 64U
+
+/** The bit of hmap_idx[] telling the table of the slot. */
+#define HMAP_IDX_TABLE (1U << (UINT_WIDTH - 1))
+
+#define HMAP_EMPTY ((signed char) -128)
+#define HMAP_DELETED ((signed char) -2)
+
+/**
+ * An hmap slot keeps the key hash next to the frame, so a probe does not
+ * read a frame unless the hash matches.
  */
-#define HMAP_BUCKETS_BITS 12U
+struct hmap_slot {
+    unsigned hash;
+    unsigned frame_idx;
+};
 
-CIRCLEQ_HEAD(hmap_bucket, hmap_item);
+/** The key to look up or NULL to match the hash only. */
+struct hmap_key {
+    void const *data;
+    unsigned len;
+};
 
-typedef unsigned (*hmap_h_func_t)(struct hmap *hmap, unsigned key);
+struct hmap_table {
+    signed char *ctrl;
+    struct hmap_slot *slots;
+    /** The number of slots less one. */
+    unsigned mask;
+};
+
+typedef unsigned (*hmap_get_func_t)(struct hmap *hmap,
+                                    struct hmap_table const *table,
+                                    unsigned hash,
+                                    struct hmap_key const *key);
 
 struct hmap {
-    struct hmap_bucket *buckets;
-    unsigned n_bits;
-    unsigned n_mask;
-    hmap_h_func_t h_func;
+    struct frames *frames;
+    struct hmap_table *tables[2];
+    /** The table keys are added to. */
+    struct hmap_table *cur;
+    /** The table keys are moved from or NULL. */
+    struct hmap_table *old;
+    /** The next slot of the old table to move. */
+    unsigned cursor;
+    /** The number of control bytes of the other table cleared. */
+    unsigned cleared;
+    /** The table drained after a resize or NULL. */
+    struct hmap_table *retired;
+    uint64_t retired_epoch;
+    /** The number of changes since the table is retired. */
+    unsigned n_retired_steps;
+    unsigned *hmap_idx;
+    /** The number of empty slots of the current table. */
+    unsigned n_empty;
+    hmap_get_func_t get;
+    unsigned capacity;
+    struct mem_attr mem;
 };
 
-struct hmap_item *hmap_item_alloc(struct frames *frames)
+static unsigned hmap_n_bits(unsigned capacity)
 {
-    struct hmap_item *item = calloc(1, sizeof(*item));
+    unsigned n = UINT_WIDTH - __builtin_clz(capacity) + 1;
 
-    ASSERT(!frames_all_used(frames));
+    die_on(n >= UINT_WIDTH, "too many frames to map: capacity %u\n",
+                            capacity);
 
-    item->frame_idx = frames_reserve(frames);
+    if ((1U << n) < HMAP_GROUP_MAX)
+        n = __builtin_ctz(HMAP_GROUP_MAX);
 
-    return item;
+    return n;
 }
 
-static void hmap_item_free(struct hmap_item *item)
+/*
+ * Hashes are mixed by the caller, so the home slot is just the low bits of
+ * the hash. It is inlined into the probe loops.
+ */
+static inline unsigned hmap_home(struct hmap_table const *table,
+                                 unsigned hash)
 {
-    free(item);
+    return hash & table->mask;
 }
 
-static void hmap_bucket_init(struct hmap_bucket *bucket)
+/*
+ * The tag is taken from the high bits the home slot does not depend on,
+ * unless the map has more than 2^25 slots.
+ */
+static inline signed char hmap_tag(unsigned hash)
 {
-    CIRCLEQ_INIT(bucket);
+    return (signed char) (hash >> 25);
 }
 
-static void hmap_bucket_free(struct hmap_bucket *bucket)
+#if !defined(HMAP_SSE2)
+static inline unsigned hmap_match_scalar(signed char const *ctrl,
+                                         signed char tag)
 {
-    struct hmap_item *item;
+    unsigned m = 0;
+    unsigned i;
 
-    while (!CIRCLEQ_EMPTY(bucket)) {
-        item = CIRCLEQ_FIRST(bucket);
-        CIRCLEQ_REMOVE(bucket, item, next);
-        hmap_item_free(item);
-    }
+    for (i = 0; i < HMAP_GROUP_MIN; ++i)
+        m |= (unsigned) (__atomic_load_n(ctrl + i, __ATOMIC_RELAXED) ==
+                         tag) << i;
+
+    return m;
 }
 
-void hmap_bucket_add(struct hmap_bucket *bucket, struct hmap_item *item)
+static inline unsigned hmap_match_empty_scalar(signed char const *ctrl)
 {
-    CIRCLEQ_INSERT_TAIL(bucket, item, next);
+    return hmap_match_scalar(ctrl, HMAP_EMPTY);
 }
+#endif
 
-void hmap_bucket_rm(struct hmap_bucket *bucket, struct hmap_item *item)
+#if defined(HMAP_SSE2)
+static inline unsigned hmap_match_sse2(signed char const *ctrl,
+                                       signed char tag)
 {
-    CIRCLEQ_REMOVE(bucket, item, next);
+    __m128i g = _mm_loadu_si128((__m128i const *) ctrl);
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(tag)));
 }
 
-static struct hmap_item *hmap_bucket_get(struct hmap_bucket *bucket, int key)
+static inline unsigned hmap_match_empty_sse2(signed char const *ctrl)
 {
-    struct hmap_item *item;
+    return hmap_match_sse2(ctrl, HMAP_EMPTY);
+}
+#endif
 
-    CIRCLEQ_FOREACH(item, bucket, next) {
-        if (item->key == key)
-            return item;
+#if defined(HMAP_AVX2)
+static inline __attribute__((target("avx2")))
+unsigned hmap_match_avx2(signed char const *ctrl, signed char tag)
+{
+    __m256i g = _mm256_loadu_si256((__m256i const *) ctrl);
+
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(g, _mm256_set1_epi8(tag)));
+}
+
+static inline __attribute__((target("avx2")))
+unsigned hmap_match_empty_avx2(signed char const *ctrl)
+{
+    return hmap_match_avx2(ctrl, HMAP_EMPTY);
+}
+#endif
+
+#define HMAP_DEFINE_GET(_isa, _attr, _width) \
+    static _attr unsigned \
+    hmap_get_ ## _isa(struct hmap *hmap, struct hmap_table const *table, \
+                      unsigned hash, struct hmap_key const *key) \
+    { \
+        signed char tag = hmap_tag(hash); \
+        unsigned pos = hmap_home(table, hash); \
+        struct hmap_slot *slot; \
+        unsigned idx; \
+        unsigned m; \
+        \
+        for (;;) { \
+            for (m = hmap_match_ ## _isa(table->ctrl + pos, tag); m; \
+                 m &= m - 1) { \
+                slot = table->slots + \
+                       ((pos + __builtin_ctz(m)) & table->mask); \
+                if (__atomic_load_n(&slot->hash, __ATOMIC_RELAXED) != hash) \
+                    continue; \
+                idx = __atomic_load_n(&slot->frame_idx, __ATOMIC_RELAXED); \
+                if (!key || frames_key_eq(hmap->frames, idx, key->data, \
+                                          key->len)) \
+                    return idx; \
+            } \
+            \
+            if (hmap_match_empty_ ## _isa(table->ctrl + pos)) \
+                return HMAP_NONE; \
+            \
+            pos = (pos + (_width)) & table->mask; \
+        } \
     }
 
-    return NULL;
+#if defined(HMAP_SSE2)
+HMAP_DEFINE_GET(sse2, , 16U)
+#else
+HMAP_DEFINE_GET(scalar, , HMAP_GROUP_MIN)
+#endif
+#if defined(HMAP_AVX2)
+HMAP_DEFINE_GET(avx2, __attribute__((target("avx2"))), 32U)
+#endif
+
+static hmap_get_func_t hmap_get_func(void)
+{
+#if defined(HMAP_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return hmap_get_avx2;
+#endif
+#if defined(HMAP_SSE2)
+    return hmap_get_sse2;
+#else
+    return hmap_get_scalar;
+#endif
 }
 
-static unsigned hmap_n_bits(unsigned capacity)
+/* The number of control bytes of a table with the mirrored ones. */
+static unsigned hmap_ctrl_size(struct hmap_table const *table)
 {
-    unsigned n = UINT_WIDTH - __builtin_clz(capacity);
+    return table->mask + 1 + HMAP_GROUP_MAX;
+}
 
-    BUILD_ASSERT(HMAP_BUCKETS_BITS < UINT_WIDTH);
+/*
+ * Allocate a table of n slots.
+ *
+ * The slots are zeroed, so a lookup racing with a put reads frame indexes,
+ * never garbage. The control bytes are cleared unless cleared is 0.
+ */
+static struct hmap_table *hmap_table_alloc(struct hmap *hmap, unsigned n,
+                                           int cleared)
+{
+    struct hmap_table *table = calloc(1, sizeof(*table));
 
-    if (n > HMAP_BUCKETS_BITS)
-        n = HMAP_BUCKETS_BITS;
+    die_on(!table, "failed to allocate hmap table\n");
 
-    return n;
+    table->mask = n - 1;
+    table->ctrl = mem_alloc(hmap_ctrl_size(table), &hmap->mem);
+    table->slots = mem_zalloc(n * sizeof(*table->slots), &hmap->mem);
+    if (cleared)
+        memset(table->ctrl, HMAP_EMPTY, hmap_ctrl_size(table));
+
+    return table;
+}
+
+static void hmap_table_free(struct hmap *hmap, struct hmap_table *table)
+{
+    mem_free(table->slots, (table->mask + 1) * sizeof(*table->slots),
+             &hmap->mem);
+    mem_free(table->ctrl, hmap_ctrl_size(table), &hmap->mem);
+    free(table);
+}
+
+/* The index of the table keys are not added to. */
+static unsigned hmap_other(struct hmap *hmap)
+{
+    return hmap->cur == hmap->tables[0];
+}
+
+static void hmap_set_ctrl(struct hmap_table *table, unsigned i,
+                          signed char c)
+{
+    __atomic_store_n(table->ctrl + i, c, __ATOMIC_RELAXED);
+    if (i < HMAP_GROUP_MAX)
+        __atomic_store_n(table->ctrl + table->mask + 1 + i, c,
+                         __ATOMIC_RELAXED);
+}
+
+/* Find the first slot of the current table not used from the home slot. */
+static unsigned hmap_find_unused(struct hmap *hmap, unsigned home)
+{
+    unsigned i = home;
+
+    while (hmap->cur->ctrl[i] >= 0)
+        i = (i + 1) & hmap->cur->mask;
+
+    return i;
+}
+
+/* Put a key to the first slot not used of the current table. */
+static void hmap_place(struct hmap *hmap, struct hmap_slot const *slot)
+{
+    struct hmap_table *table = hmap->cur;
+    unsigned i = hmap_find_unused(hmap, hmap_home(table, slot->hash));
+
+    hmap->n_empty -= table->ctrl[i] == HMAP_EMPTY;
+
+    __atomic_store_n(&table->slots[i].hash, slot->hash, __ATOMIC_RELAXED);
+    __atomic_store_n(&table->slots[i].frame_idx, slot->frame_idx,
+                     __ATOMIC_RELAXED);
+    hmap_set_ctrl(table, i, hmap_tag(slot->hash));
+    hmap->hmap_idx[slot->frame_idx] = table == hmap->tables[0] ?
+                                      i : i | HMAP_IDX_TABLE;
 }
 
-static unsigned hmap_h_func_8(struct hmap *hmap, unsigned key)
+/*
+ * Retire the old table drained after a resize, a table of the size of
+ * the current one takes its turn. Its control bytes are cleared later.
+ */
+static void hmap_retire(struct hmap *hmap)
 {
-    unsigned h = key ^ (key >> 8) ^ (key >> 16) ^ (key >> 24);
+    unsigned other = hmap_other(hmap);
+
+    hmap->retired = hmap->tables[other];
+    hmap->retired_epoch = epoch_now();
+    hmap->n_retired_steps = 0;
+    hmap->tables[other] = hmap_table_alloc(hmap, hmap->cur->mask + 1, 0);
+}
 
-    h = h ^ (h >> hmap->n_bits);
+/* Free the table retired once no lookup can read it. */
+static void hmap_reclaim(struct hmap *hmap)
+{
+    if (epoch_advance() < hmap->retired_epoch + EPOCH_GRACE)
+        return;
 
-    return h & hmap->n_mask;
+    hmap_table_free(hmap, hmap->retired);
+    hmap->retired = NULL;
 }
 
-static unsigned hmap_h_func_4(struct hmap *hmap, unsigned key)
+/* Move the keys of up to n slots of the old table. */
+static void hmap_migrate(struct hmap *hmap, unsigned n)
 {
-    unsigned h = key ^ (key >> 16);
+    struct hmap_table *old = hmap->old;
+    unsigned i;
 
-    h = h ^ (h >> hmap->n_bits);
+    for (; n && hmap->cursor <= old->mask; --n) {
+        i = hmap->cursor++;
+        if (old->ctrl[i] < 0)
+            continue;
 
-    return h & hmap->n_mask;
+        hmap_place(hmap, old->slots + i);
+        hmap_set_ctrl(old, i, HMAP_DELETED);
+    }
+
+    if (hmap->cursor > old->mask) {
+        __atomic_store_n(&hmap->old, NULL, __ATOMIC_RELEASE);
+        if (old->mask != hmap->cur->mask)
+            hmap_retire(hmap);
+        hmap->cleared = 0;
+        DPRINT(0, "hmap: moved with %u empty slots\n", hmap->n_empty);
+    }
 }
 
-static unsigned hmap_h_func_2(struct hmap *hmap, unsigned key)
+/* Clear up to n control bytes of the other table once it is drained. */
+static void hmap_clear(struct hmap *hmap, unsigned n)
 {
-    unsigned h = key;
+    struct hmap_table *table = hmap->tables[hmap_other(hmap)];
+    unsigned size = hmap_ctrl_size(table);
+
+    if (n > size - hmap->cleared)
+        n = size - hmap->cleared;
+
+    /* A lookup that has loaded the table before it was drained reads it. */
+    for (; n; --n)
+        __atomic_store_n(table->ctrl + hmap->cleared++, HMAP_EMPTY,
+                         __ATOMIC_RELAXED);
+}
+
+/*
+ * Move a part of the keys or clear a part of the other table.
+ *
+ * An old table larger than the current one moves as many more slots.
+ */
+static void hmap_step(struct hmap *hmap)
+{
+    struct hmap_table *old = hmap->old;
+
+    if (old)
+        hmap_migrate(hmap, old->mask <= hmap->cur->mask ? HMAP_MIGRATE_SLOTS :
+                           HMAP_MIGRATE_SLOTS * ((old->mask + 1) /
+                                                 (hmap->cur->mask + 1)));
+    else if (hmap->cleared < hmap_ctrl_size(hmap->tables[hmap_other(hmap)]))
+        hmap_clear(hmap, HMAP_CLEAR_BYTES);
+
+    if (hmap->retired &&
+        ++hmap->n_retired_steps % HMAP_RECLAIM_STEPS == 0)
+        hmap_reclaim(hmap);
+}
+
+/* Start to move the keys to the other table to drop deleted slots. */
+static void hmap_rehash(struct hmap *hmap)
+{
+    unsigned other = hmap_other(hmap);
+    struct hmap_table *table;
+
+    /* Not expected, as the old table is drained and cleared well before. */
+    if (hmap->old)
+        hmap_migrate(hmap, hmap->old->mask + 1);
+    table = hmap->tables[other];
+    hmap_clear(hmap, hmap_ctrl_size(table));
 
-    h = h ^ (h >> hmap->n_bits);
+    hmap->n_empty = table->mask + 1;
+    hmap->cursor = 0;
 
-    return h & hmap->n_mask;
+    __atomic_store_n(&hmap->old, hmap->cur, __ATOMIC_RELEASE);
+    __atomic_store_n(&hmap->cur, table, __ATOMIC_RELEASE);
+
+    DPRINT(0, "hmap: move keys to table %u\n", other);
 }
 
-static hmap_h_func_t hmap_h_func(unsigned bits)
+/* Get the table and the slot of a frame mapped. */
+static struct hmap_table *hmap_slot_of(struct hmap *hmap, unsigned frame_idx,
+                                       unsigned *i)
 {
-    if (bits <= 4)
-        return hmap_h_func_8;
-    else if (bits <= 8)
-        return hmap_h_func_4;
-    else
-        return hmap_h_func_2;
+    unsigned idx = hmap->hmap_idx[frame_idx];
+    struct hmap_table *table = hmap->tables[!!(idx & HMAP_IDX_TABLE)];
+
+    *i = idx & ~HMAP_IDX_TABLE;
+
+    ASSERT(table->slots[*i].frame_idx == frame_idx &&
+           table->ctrl[*i] >= 0);
+
+    return table;
 }
 
-struct hmap *hmap_alloc(unsigned capacity)
+struct hmap *hmap_alloc(unsigned capacity, struct frames *frames,
+                        struct mem_attr const *mem)
 {
     struct hmap *hmap;
+    unsigned n;
     unsigned i;
 
     ASSERT(capacity > 0);
 
-    hmap = malloc(sizeof(*hmap));
+    hmap = calloc(1, sizeof(*hmap));
     die_on(!hmap, "failed to allocate hmap\n");
 
-    hmap->n_bits = hmap_n_bits(capacity);
-    hmap->n_mask = (1U << hmap->n_bits) - 1U;
+    if (mem)
+        hmap->mem = *mem;
 
-    hmap->buckets = malloc((hmap->n_mask + 1) * sizeof(*hmap->buckets));
-    die_on(!hmap->buckets, "failed to allocate hmap storage: capacity %u\n",
-                           capacity);
+    n = 1U << hmap_n_bits(capacity);
+    for (i = 0; i < 2; ++i)
+        hmap->tables[i] = hmap_table_alloc(hmap, n, 1);
 
-    hmap->h_func = hmap_h_func(hmap->n_bits);
+    hmap->hmap_idx = mem_alloc(capacity * sizeof(*hmap->hmap_idx),
+                               &hmap->mem);
+    hmap->capacity = capacity;
 
-    for (i = 0; i < hmap->n_mask + 1; ++i)
-        hmap_bucket_init(hmap->buckets + i);
+    hmap->cur = hmap->tables[0];
+    hmap->cleared = hmap_ctrl_size(hmap->tables[1]);
+    hmap->frames = frames;
+    hmap->n_empty = n;
+    hmap->get = hmap_get_func();
 
     return hmap;
 }
@@ -170,38 +543,205 @@ void hmap_free(struct hmap *hmap)
 {
     unsigned i;
 
-    for (i = 0; i < hmap->n_mask + 1; ++i)
-        hmap_bucket_free(hmap->buckets + i);
+    mem_free(hmap->hmap_idx, hmap->capacity * sizeof(*hmap->hmap_idx),
+             &hmap->mem);
+
+    for (i = 0; i < 2; ++i)
+        hmap_table_free(hmap, hmap->tables[i]);
+    if (hmap->retired)
+        hmap_table_free(hmap, hmap->retired);
 
     free(hmap);
 }
 
-void hmap_add(struct hmap *hmap, struct hmap_item *item)
+void hmap_resize(struct hmap *hmap, unsigned capacity)
 {
-    unsigned i = hmap->h_func(hmap, item->key);
-    struct hmap_bucket *bucket = hmap->buckets + i;
+    unsigned n = 1U << hmap_n_bits(capacity);
+    unsigned *hmap_idx;
+    unsigned other;
+
+    ASSERT(capacity > 0);
+
+    if (hmap->old)
+        hmap_migrate(hmap, hmap->old->mask + 1);
+    if (hmap->retired) {
+        hmap_table_free(hmap, hmap->retired);
+        hmap->retired = NULL;
+    }
+
+    hmap_idx = mem_alloc(capacity * sizeof(*hmap_idx), &hmap->mem);
+    memcpy(hmap_idx, hmap->hmap_idx,
+           (capacity < hmap->capacity ? capacity : hmap->capacity) *
+           sizeof(*hmap_idx));
+    mem_free(hmap->hmap_idx, hmap->capacity * sizeof(*hmap->hmap_idx),
+             &hmap->mem);
+    hmap->hmap_idx = hmap_idx;
+    hmap->capacity = capacity;
+
+    if (n == hmap->cur->mask + 1)
+        return;
 
-    DPRINT(0, "hmap: add key %u with idx %u (frame %u)\n",
-           item->key, i, item->frame_idx);
-    item->hmap_idx = i;
-    hmap_bucket_add(bucket, item);
+    /* No lookup reads the other table, it has been drained before. */
+    other = hmap_other(hmap);
+    hmap_table_free(hmap, hmap->tables[other]);
+    hmap->tables[other] = hmap_table_alloc(hmap, n, 1);
+
+    hmap->n_empty = n;
+    hmap->cursor = 0;
+
+    __atomic_store_n(&hmap->old, hmap->cur, __ATOMIC_RELEASE);
+    __atomic_store_n(&hmap->cur, hmap->tables[other], __ATOMIC_RELEASE);
+
+    DPRINT(0, "hmap: resize to %u slots in table %u\n", n, other);
+}
+
+void hmap_move(struct hmap *hmap, unsigned from, unsigned to)
+{
+    struct hmap_table *table;
+    unsigned i;
+
+    table = hmap_slot_of(hmap, from, &i);
+    __atomic_store_n(&table->slots[i].frame_idx, to, __ATOMIC_RELAXED);
+    hmap->hmap_idx[to] = hmap->hmap_idx[from];
 }
 
-void hmap_rm(struct hmap *hmap, struct hmap_item *item)
+void hmap_add(struct hmap *hmap, unsigned hash, unsigned frame_idx)
 {
-    struct hmap_bucket *bucket = hmap->buckets + item->hmap_idx;
+    struct hmap_slot slot = {
+        .hash = hash,
+        .frame_idx = frame_idx,
+    };
 
-    ASSERT(item->hmap_idx == hmap->h_func(hmap, item->key));
+    hmap_step(hmap);
+
+    /* Keep at least 1/8 of slots empty for lookups to stop early. */
+    if (hmap->n_empty <= (hmap->cur->mask + 1) / 8) {
+        hmap_rehash(hmap);
+        hmap_migrate(hmap, HMAP_MIGRATE_SLOTS);
+    }
 
-    DPRINT(0, "hmap: rm key %u with idx %u (frame %u)\n",
-           item->key, item->hmap_idx, item->frame_idx);
-    hmap_bucket_rm(bucket, item);
+    DPRINT(0, "hmap: add hash %#x (frame %u)\n", hash, frame_idx);
+    hmap_place(hmap, &slot);
 }
 
-struct hmap_item *hmap_get(struct hmap *hmap, int key)
+unsigned hmap_hash(struct hmap *hmap, unsigned frame_idx)
 {
-    unsigned i = hmap->h_func(hmap, key);
-    struct hmap_bucket *bucket = hmap->buckets + i;
+    unsigned i;
+
+    return hmap_slot_of(hmap, frame_idx, &i)->slots[i].hash;
+}
+
+void hmap_rm(struct hmap *hmap, unsigned frame_idx)
+{
+    struct hmap_table *table;
+    signed char const *ctrl;
+    unsigned before = 0;
+    unsigned after = 0;
+    unsigned i;
+
+    table = hmap_slot_of(hmap, frame_idx, &i);
+    ctrl = table->ctrl;
+
+    DPRINT(0, "hmap: rm hash %#x with idx %u (frame %u)\n",
+           table->slots[i].hash, i, frame_idx);
+
+    if (table == hmap->old) {
+        /* Lookups of the keys left in the old table probe past it. */
+        hmap_set_ctrl(table, i, HMAP_DELETED);
+    } else {
+        while (before < HMAP_GROUP_MIN &&
+               ctrl[(i - before - 1) & table->mask] != HMAP_EMPTY)
+            ++before;
+        while (after < HMAP_GROUP_MIN &&
+               ctrl[(i + after + 1) & table->mask] != HMAP_EMPTY)
+            ++after;
+
+        if (before + after + 1 < HMAP_GROUP_MIN) {
+            hmap_set_ctrl(table, i, HMAP_EMPTY);
+            ++hmap->n_empty;
+        } else {
+            hmap_set_ctrl(table, i, HMAP_DELETED);
+        }
+    }
+
+    hmap_step(hmap);
+}
+
+/*
+ * Look up a key in the current table, then in the old one. A key moved
+ * meanwhile may be missed by a lookup racing with changes only.
+ */
+static unsigned hmap_lookup(struct hmap *hmap, unsigned hash,
+                            struct hmap_key const *key)
+{
+    struct hmap_table *old = __atomic_load_n(&hmap->old, __ATOMIC_ACQUIRE);
+    struct hmap_table *cur = __atomic_load_n(&hmap->cur, __ATOMIC_ACQUIRE);
+    unsigned idx = hmap->get(hmap, cur, hash, key);
+
+    if (idx == HMAP_NONE && old && old != cur)
+        idx = hmap->get(hmap, old, hash, key);
+
+    return idx;
+}
+
+void hmap_prefetch(struct hmap *hmap, unsigned hash)
+{
+    struct hmap_table *cur = __atomic_load_n(&hmap->cur, __ATOMIC_ACQUIRE);
+    unsigned home = hmap_home(cur, hash);
+
+    __builtin_prefetch(cur->ctrl + home);
+    __builtin_prefetch(cur->slots + home);
+}
+
+unsigned hmap_peek(struct hmap *hmap, unsigned hash)
+{
+    return hmap_lookup(hmap, hash, NULL);
+}
+
+unsigned hmap_get(struct hmap *hmap, void const *key, unsigned key_len,
+                  unsigned hash)
+{
+    struct hmap_key k = {
+        .data = key,
+        .len = key_len,
+    };
+
+    return hmap_lookup(hmap, hash, &k);
+}
+
+/* Add the used slots of a table from a slot on to the statistics. */
+static void hmap_stats_table(struct hmap_table const *table, unsigned from,
+                             struct hmap_stats *stats)
+{
+    unsigned i;
+    unsigned d;
+    unsigned bin;
+
+    for (i = from; i < table->mask + 1; ++i) {
+        if (table->ctrl[i] < 0)
+            continue;
+
+        ++stats->n_used;
+
+        d = (i - hmap_home(table, table->slots[i].hash)) & table->mask;
+        bin = UINT_WIDTH - 1 - __builtin_clz(d + 1);
+        if (bin >= HMAP_STATS_PROBES)
+            bin = HMAP_STATS_PROBES - 1;
+        ++stats->probes[bin];
+    }
+}
+
+void hmap_stats(struct hmap *hmap, struct hmap_stats *stats)
+{
+    unsigned i;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->n_slots = hmap->cur->mask + 1;
+
+    for (i = 0; i < hmap->cur->mask + 1; ++i)
+        stats->n_deleted += hmap->cur->ctrl[i] == HMAP_DELETED;
 
-    return hmap_bucket_get(bucket, key);
+    hmap_stats_table(hmap->cur, 0, stats);
+    if (hmap->old)
+        hmap_stats_table(hmap->old, hmap->cursor, stats);
 }
@@ -5,74 +5,1693 @@
  * @author Boris Stankevich <microsoft-wanted@yandex.ru>
  * @copyright GPL-3.0+
  */
+#include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "lru_cache/log.h"
+#include "lru_cache/epoch.h"
 #include "lru_cache/frames.h"
-#include "lru_cache/lrul.h"
+#include "lru_cache/policy.h"
 #include "lru_cache/hmap.h"
+#include "lru_cache/hash.h"
+#include "lru_cache/mem.h"
+#include "lru_cache/twheel.h"
 #include "lru_cache/lru_cache.h"
 
-struct lru_cache {
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+/*
+ * The cache is a set of shards, each is an independent LRU cache for the
+ * keys hashed into it.
+ *
+ * A shard is aligned to a cache line, so the lock of a shard does not
+ * share a line with the lock or data of another shard.
+ */
+/*
+ * Hits and misses may be counted under a shared lock, loads under the load
+ * lock, so they are added atomically. The other counters are changed
+ * under the exclusive lock.
+ */
+struct lru_shard_stats {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long inserts;
+    unsigned long long updates;
+    unsigned long long evictions;
+    unsigned long long expirations;
+    unsigned long long loads;
+    unsigned long long coalesced;
+    unsigned long long hits_dropped;
+};
+
+/*
+ * Hits of a shard with read buffers are appended to a buffer of the
+ * thread's stripe under the shared lock or without locks, and applied to
+ * the policy in batches under the exclusive lock: by a thread filling a
+ * buffer up to a batch if the lock is free, and by every put before it
+ * changes the shard. A hit finding its buffer full is dropped.
+ *
+ * A buffer is a ring of frame indexes. A hit reserves an entry by moving
+ * the tail and then stores the index, so the drain stops at an entry not
+ * stored yet. The drain clears the entries it takes before it moves the
+ * head. An entry may refer to a frame reused since the hit, the hit is
+ * recorded only if the frame is still used.
+ */
+#define LRU_RBUF_SIZE 32U
+#define LRU_RBUF_MASK (LRU_RBUF_SIZE - 1U)
+#define LRU_RBUF_BATCH (LRU_RBUF_SIZE / 2U)
+#define LRU_RBUF_STRIPES 4U
+#define LRU_RBUF_NONE (~0U)
+
+struct lru_rbuf {
+    unsigned head;
+    unsigned tail;
+    unsigned idxs[LRU_RBUF_SIZE];
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+/*
+ * A load in flight. It lives on the stack of the loading thread, which
+ * waits for the waiters of the load to leave before it returns.
+ */
+struct lru_load {
+    struct lru_load *next;
+    int key;
+    unsigned hash;
+    /** The number of threads waiting for the load. */
+    unsigned n_waiters;
+    int done;
+    int rc;
+    int value;
+};
+
+struct lru_shard {
+    pthread_rwlock_t lock;
+    /**
+     * The count of the changes of the hash map for lookups without locks,
+     * odd while a change is in progress.
+     */
+    unsigned seq;
+    /** Lookups without locks take the shared lock during a resize. */
+    int resizing;
+    unsigned capacity;
     struct frames *frames;
-    struct lrul *lrul;
+    void *policy;
     struct hmap *hmap;
+    /** The expiration of keys with a TTL, allocated on the first one. */
+    struct twheel *ttl;
+    /** The weights of the frames for a cache with a budget or NULL. */
+    unsigned *weights;
+    uint64_t budget;
+    /** The weight of the keys cached. */
+    uint64_t weight;
+    /** The read buffers of hits or NULL to record hits at once. */
+    struct lru_rbuf *rbufs;
+    /** A read buffer is filled up to a batch. */
+    int drain;
+    struct lru_shard_stats stats;
+    /** Protects the loads in flight, which are taken before the lock. */
+    pthread_mutex_t load_lock;
+    pthread_cond_t load_cond;
+    struct lru_load *loads;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+struct lru_cache {
+    struct lru_shard *shards;
+    unsigned n_shards;
+    struct policy_ops const *ops;
+    /** Shards are locked on access. */
+    int locked;
+    /** Gets do not lock shards, puts defer the release of frame data. */
+    int lockless;
+    /** The arguments the cache is created with, or resized to. */
+    unsigned capacity;
+    struct lru_cache_attr attr;
+    /** The seed of the key hashes. */
+    uint64_t seed;
+    /** The attributes of the memory of the shards. */
+    struct mem_attr mem;
 };
 
-struct lru_cache *lru_cache_alloc(unsigned capacity)
+static struct policy_ops const *const lru_cache_policy_ops[] = {
+    [LRU_CACHE_POLICY_LRU] = &policy_lru_ops,
+    [LRU_CACHE_POLICY_CLOCK] = &policy_clock_ops,
+    [LRU_CACHE_POLICY_TINYLFU] = &policy_tinylfu_ops,
+    [LRU_CACHE_POLICY_SLRU] = &policy_slru_ops,
+    [LRU_CACHE_POLICY_ARC] = &policy_arc_ops,
+};
+
+static void lru_shard_init(struct lru_shard *shard,
+                           struct policy_ops const *ops, unsigned capacity,
+                           uint64_t budget, int lockless, int buffered,
+                           struct mem_attr const *mem)
+{
+    unsigned i, j;
+
+    int rc = pthread_rwlock_init(&shard->lock, NULL);
+
+    die_on(rc, "failed to initialize lru cache shard lock: %d\n", rc);
+    rc = pthread_mutex_init(&shard->load_lock, NULL);
+    die_on(rc, "failed to initialize lru cache shard load lock: %d\n", rc);
+    rc = pthread_cond_init(&shard->load_cond, NULL);
+    die_on(rc, "failed to initialize lru cache shard load cond: %d\n", rc);
+
+    shard->seq = 0;
+    shard->resizing = 0;
+    shard->capacity = capacity;
+    shard->frames = frames_alloc(capacity, mem);
+    if (lockless)
+        frames_defer(shard->frames);
+    shard->policy = ops->alloc(capacity, mem);
+    shard->hmap = hmap_alloc(capacity, shard->frames, mem);
+    shard->ttl = NULL;
+    shard->weights = budget ? mem_alloc(capacity * sizeof(*shard->weights),
+                                        mem) : NULL;
+    shard->budget = budget;
+    shard->weight = 0;
+    shard->rbufs = NULL;
+    shard->drain = 0;
+
+    if (buffered) {
+        rc = posix_memalign((void **) &shard->rbufs, CACHE_LINE_SIZE,
+                            LRU_RBUF_STRIPES * sizeof(*shard->rbufs));
+        die_on(rc, "failed to allocate lru cache read buffers\n");
+        for (i = 0; i < LRU_RBUF_STRIPES; ++i) {
+            shard->rbufs[i].head = 0;
+            shard->rbufs[i].tail = 0;
+            for (j = 0; j < LRU_RBUF_SIZE; ++j)
+                shard->rbufs[i].idxs[j] = LRU_RBUF_NONE;
+        }
+    }
+    memset(&shard->stats, 0, sizeof(shard->stats));
+    shard->loads = NULL;
+}
+
+static void lru_shard_fini(struct lru_shard *shard,
+                           struct policy_ops const *ops,
+                           struct mem_attr const *mem)
+{
+    free(shard->rbufs);
+    if (shard->weights)
+        mem_free(shard->weights, shard->capacity * sizeof(*shard->weights),
+                 mem);
+    if (shard->ttl)
+        twheel_free(shard->ttl);
+    hmap_free(shard->hmap);
+    ops->free(shard->policy);
+    frames_free(shard->frames);
+    pthread_cond_destroy(&shard->load_cond);
+    pthread_mutex_destroy(&shard->load_lock);
+    pthread_rwlock_destroy(&shard->lock);
+}
+
+/*
+ * TTLs are counted in milliseconds of the monotonic clock. The clock is
+ * read only for keys with a TTL and for puts into a shard with such keys.
+ */
+static uint64_t lru_cache_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000U + ts.tv_nsec / 1000000U;
+}
+
+struct lru_shard_expire_ctx {
+    struct lru_shard *shard;
+    struct policy_ops const *ops;
+};
+
+/* Return the frame of a key out of the policy to the unused frames. */
+static void lru_shard_release(struct lru_shard *shard, unsigned idx)
+{
+    hmap_rm(shard->hmap, idx);
+    if (shard->ttl)
+        twheel_rm(shard->ttl, idx);
+    if (shard->weights)
+        shard->weight -= shard->weights[idx];
+    frames_rm(shard->frames, idx);
+}
+
+static void lru_shard_expire(void *ctx, unsigned idx)
+{
+    struct lru_shard_expire_ctx *ec = ctx;
+
+    ec->ops->rm_item(ec->shard->policy, idx);
+    lru_shard_release(ec->shard, idx);
+    ++ec->shard->stats.expirations;
+}
+
+static int lru_shard_expired(struct lru_shard *shard, unsigned idx)
+{
+    /* The wheel is published to lookups without locks once it is set up. */
+    struct twheel *ttl = __atomic_load_n(&shard->ttl, __ATOMIC_ACQUIRE);
+    uint64_t expire;
+
+    if (!ttl)
+        return 0;
+
+    expire = twheel_expire(ttl, idx);
+
+    return expire && expire <= lru_cache_now();
+}
+
+/*
+ * Evict keys until a weight fits the budget on top of the weight cached.
+ *
+ * @param pin A key not to evict, it keeps its place in the policy, or
+ *            POLICY_NONE.
+ */
+static void lru_shard_fit(struct lru_shard *shard,
+                          struct policy_ops const *ops, unsigned weight,
+                          unsigned pin)
+{
+    unsigned n_keep = pin != POLICY_NONE;
+
+    while (shard->weight + weight > shard->budget &&
+           frames_used(shard->frames) > n_keep) {
+        lru_shard_release(shard, ops->rm(shard->policy, pin));
+        ++shard->stats.evictions;
+    }
+}
+
+/* The weight of a key is the memory of its key and value. */
+#define LRU_WEIGHT_DATA (~0U)
+
+/*
+ * Put a key.
+ *
+ * @param expire The time the key expires at or 0.
+ * @param weight The weight of the key or LRU_WEIGHT_DATA.
+ */
+static void lru_shard_put(struct lru_shard *shard,
+                          struct policy_ops const *ops,
+                          void const *key, unsigned key_len, unsigned hash,
+                          void const *value, unsigned value_len,
+                          uint64_t expire, unsigned weight)
+{
+    struct lru_shard_expire_ctx ec = {
+        .shard = shard,
+        .ops = ops,
+    };
+    unsigned idx;
+
+    /*
+     * Expired keys free their frames before a live key is evicted. An
+     * empty wheel is advanced too, so a key put after an idle time is
+     * added to a wheel at the current time.
+     */
+    if (shard->ttl)
+        twheel_advance(shard->ttl, lru_cache_now(), lru_shard_expire, &ec);
+
+    if (shard->weights && weight == LRU_WEIGHT_DATA)
+        weight = frames_data_size(key_len, value_len);
+
+    idx = hmap_get(shard->hmap, key, key_len, hash);
+    if (idx != HMAP_NONE) {
+        ++shard->stats.updates;
+
+        /* The previous value is not kept in place of the new one. */
+        if (shard->weights && weight > shard->budget) {
+            ops->rm_item(shard->policy, idx);
+            lru_shard_release(shard, idx);
+            return;
+        }
+
+        ops->hit(shard->policy, idx);
+        frames_set_value(shard->frames, idx, value, value_len);
+        if (shard->ttl)
+            twheel_rm(shard->ttl, idx);
+        if (expire)
+            twheel_add(shard->ttl, idx, expire);
+
+        /* The key is pinned not to evict itself. */
+        if (shard->weights) {
+            shard->weight = shard->weight - shard->weights[idx] + weight;
+            shard->weights[idx] = weight;
+            if (shard->weight > shard->budget)
+                lru_shard_fit(shard, ops, 0, idx);
+        }
+        return;
+    }
+
+    if (shard->weights) {
+        if (weight > shard->budget)
+            return;
+        lru_shard_fit(shard, ops, weight, POLICY_NONE);
+    }
+
+    if (frames_all_used(shard->frames)) {
+        idx = ops->rm(shard->policy, POLICY_NONE);
+        hmap_rm(shard->hmap, idx);
+        if (shard->ttl)
+            twheel_rm(shard->ttl, idx);
+        if (shard->weights)
+            shard->weight -= shard->weights[idx];
+        ++shard->stats.evictions;
+    } else {
+        idx = frames_reserve(shard->frames);
+    }
+
+    ++shard->stats.inserts;
+
+    frames_set(shard->frames, idx, key, key_len, value, value_len);
+    hmap_add(shard->hmap, hash, idx);
+    ops->add(shard->policy, idx, hash);
+    if (expire)
+        twheel_add(shard->ttl, idx, expire);
+    if (shard->weights) {
+        shard->weights[idx] = weight;
+        shard->weight += weight;
+    }
+}
+
+/* The stripe of the read buffers of the calling thread. */
+static unsigned lru_rbuf_stripe(void)
+{
+    static unsigned n_threads;
+    static __thread unsigned id;
+
+    if (!id)
+        id = __atomic_add_fetch(&n_threads, 1, __ATOMIC_RELAXED);
+
+    return id % LRU_RBUF_STRIPES;
+}
+
+/*
+ * Append a hit to a read buffer or drop it if the buffer is full.
+ *
+ * The shard is marked to drain once the buffer is filled up to a batch
+ * or overflows.
+ */
+static void lru_rbuf_add(struct lru_shard *shard, unsigned idx)
+{
+    struct lru_rbuf *rb = shard->rbufs + lru_rbuf_stripe();
+    unsigned tail = __atomic_load_n(&rb->tail, __ATOMIC_RELAXED);
+    unsigned n;
+
+    do {
+        n = tail - __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE);
+        if (n >= LRU_RBUF_SIZE) {
+            __atomic_fetch_add(&shard->stats.hits_dropped, 1,
+                               __ATOMIC_RELAXED);
+            __atomic_store_n(&shard->drain, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&rb->tail, &tail, tail + 1, 1,
+                                          __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED));
+
+    __atomic_store_n(rb->idxs + (tail & LRU_RBUF_MASK), idx,
+                     __ATOMIC_RELEASE);
+
+    if (n + 1 == LRU_RBUF_BATCH)
+        __atomic_store_n(&shard->drain, 1, __ATOMIC_RELAXED);
+}
+
+/* Apply the hits of the read buffers to the policy under the lock. */
+static void lru_shard_drain(struct lru_shard *shard,
+                            struct policy_ops const *ops)
+{
+    struct lru_rbuf *rb;
+    unsigned head;
+    unsigned tail;
+    unsigned idx;
+    unsigned i;
+
+    __atomic_store_n(&shard->drain, 0, __ATOMIC_RELAXED);
+
+    for (i = 0; i < LRU_RBUF_STRIPES; ++i) {
+        rb = shard->rbufs + i;
+        tail = __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE);
+
+        for (head = rb->head; head != tail; ++head) {
+            idx = __atomic_load_n(rb->idxs + (head & LRU_RBUF_MASK),
+                                  __ATOMIC_ACQUIRE);
+            if (idx == LRU_RBUF_NONE)
+                break;
+
+            __atomic_store_n(rb->idxs + (head & LRU_RBUF_MASK),
+                             LRU_RBUF_NONE, __ATOMIC_RELAXED);
+            if (frames_data(shard->frames, idx))
+                ops->hit(shard->policy, idx);
+        }
+
+        __atomic_store_n(&rb->head, head, __ATOMIC_RELEASE);
+    }
+}
+
+/* Drain the read buffers if they are filled up and the lock is free. */
+static void lru_shard_try_drain(struct lru_shard *shard,
+                                struct policy_ops const *ops)
+{
+    if (!shard->rbufs || !__atomic_load_n(&shard->drain, __ATOMIC_RELAXED))
+        return;
+
+    if (pthread_rwlock_trywrlock(&shard->lock))
+        return;
+
+    lru_shard_drain(shard, ops);
+    pthread_rwlock_unlock(&shard->lock);
+}
+
+/* Record a hit at once or in a read buffer. */
+static void lru_shard_hit(struct lru_shard *shard,
+                          struct policy_ops const *ops, unsigned idx)
+{
+    if (shard->rbufs)
+        lru_rbuf_add(shard, idx);
+    else
+        ops->hit(shard->policy, idx);
+}
+
+/*
+ * Look up a key and record the hit.
+ *
+ * An expired key is not found, it is reclaimed by a following put.
+ *
+ * @retval The index of the frame or HMAP_NONE.
+ */
+static unsigned lru_shard_find(struct lru_shard *shard,
+                               struct policy_ops const *ops,
+                               void const *key, unsigned key_len,
+                               unsigned hash)
+{
+    unsigned idx = hmap_get(shard->hmap, key, key_len, hash);
+
+    if (idx == HMAP_NONE || lru_shard_expired(shard, idx))
+        return HMAP_NONE;
+
+    lru_shard_hit(shard, ops, idx);
+
+    return idx;
+}
+
+/* Look up a key, record the hit and count the hit or the miss. */
+static unsigned lru_shard_get(struct lru_shard *shard,
+                              struct policy_ops const *ops,
+                              void const *key, unsigned key_len, unsigned hash)
+{
+    unsigned idx = lru_shard_find(shard, ops, key, key_len, hash);
+
+    if (idx == HMAP_NONE) {
+        __atomic_fetch_add(&shard->stats.misses, 1, __ATOMIC_RELAXED);
+        return idx;
+    }
+
+    __atomic_fetch_add(&shard->stats.hits, 1, __ATOMIC_RELAXED);
+
+    return idx;
+}
+
+/* Copy the value of a frame, if any, and get the length of the value. */
+static long lru_shard_copy(struct lru_shard *shard, unsigned idx,
+                           void *buf, unsigned size)
+{
+    void const *value;
+    unsigned len;
+
+    if (idx == HMAP_NONE)
+        return -1;
+
+    value = frames_value(shard->frames, idx, &len);
+    memcpy(buf, value, len < size ? len : size);
+
+    return len;
+}
+
+/*
+ * A lookup without locks that races with puts this many times in a row
+ * takes the shared lock.
+ */
+#define LRU_SHARD_READ_TRIES 4U
+
+/*
+ * Record a hit found without locks.
+ *
+ * The policies with a shared hit record it atomically, the others in the
+ * read buffers, which a cache with lookups without locks always has for
+ * them. So, a hit takes no lock unless it fills a buffer up.
+ */
+static void lru_shard_read_hit(struct lru_shard *shard,
+                               struct policy_ops const *ops, unsigned idx)
+{
+    if (ops->shared_hit) {
+        ops->hit(shard->policy, idx);
+        return;
+    }
+
+    ASSERT(shard->rbufs);
+
+    lru_rbuf_add(shard, idx);
+    lru_shard_try_drain(shard, ops);
+}
+
+/*
+ * Look up a key under the shared lock for a lookup without locks.
+ *
+ * The bytes found stay valid within the epoch read section, but the frame
+ * may be moved by a resize once the lock is released. So, the hit is
+ * recorded under the lock, atomically or in the read buffers.
+ */
+static void const *lru_shard_read_locked(struct lru_shard *shard,
+                                         struct policy_ops const *ops,
+                                         void const *key, unsigned key_len,
+                                         unsigned hash)
 {
+    void const *data = NULL;
+    unsigned idx;
+
+    pthread_rwlock_rdlock(&shard->lock);
+    idx = hmap_get(shard->hmap, key, key_len, hash);
+    if (idx != HMAP_NONE && !lru_shard_expired(shard, idx)) {
+        data = frames_data(shard->frames, idx);
+        ASSERT(ops->shared_hit || shard->rbufs);
+        lru_shard_hit(shard, ops, idx);
+    }
+    pthread_rwlock_unlock(&shard->lock);
+    lru_shard_try_drain(shard, ops);
+
+    return data;
+}
+
+/*
+ * Look up a key without locks and record the hit.
+ *
+ * It runs within an epoch read section, the bytes found are valid until
+ * the section is left. A hit is checked against the bytes of the frame
+ * found, a miss against the count of changes of the shard: a lookup
+ * racing with a put is retried, so a key is not missed for being moved.
+ *
+ * @param count Count the hit or the miss.
+ * @retval The bytes of the frame of the key or NULL.
+ */
+static void const *lru_shard_read(struct lru_shard *shard,
+                                  struct policy_ops const *ops,
+                                  void const *key, unsigned key_len,
+                                  unsigned hash, int count)
+{
+    void const *data = NULL;
+    unsigned idx = HMAP_NONE;
+    unsigned seq;
+    unsigned i = LRU_SHARD_READ_TRIES;
+
+    /* A shard being resized is read under the lock. */
+    if (!__atomic_load_n(&shard->resizing, __ATOMIC_ACQUIRE)) {
+        for (i = 0; i < LRU_SHARD_READ_TRIES; ++i) {
+            seq = __atomic_load_n(&shard->seq, __ATOMIC_ACQUIRE);
+            idx = hmap_get(shard->hmap, key, key_len, hash);
+            data = idx != HMAP_NONE ? frames_data(shard->frames, idx) : NULL;
+            if (data && frames_data_key_eq(data, key, key_len))
+                break;
+
+            data = NULL;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (!(seq & 1) &&
+                __atomic_load_n(&shard->seq, __ATOMIC_RELAXED) == seq)
+                break;
+        }
+    }
+
+    if (i < LRU_SHARD_READ_TRIES) {
+        if (data && lru_shard_expired(shard, idx))
+            data = NULL;
+        if (data)
+            lru_shard_read_hit(shard, ops, idx);
+    } else {
+        data = lru_shard_read_locked(shard, ops, key, key_len, hash);
+    }
+
+    if (count)
+        __atomic_fetch_add(data ? &shard->stats.hits : &shard->stats.misses,
+                           1, __ATOMIC_RELAXED);
+
+    return data;
+}
+
+/* Copy a value found without locks and get the length of the value. */
+static long lru_shard_read_copy(struct lru_shard *shard,
+                                struct policy_ops const *ops,
+                                void const *key, unsigned key_len,
+                                unsigned hash, int count,
+                                void *buf, unsigned size)
+{
+    void const *data;
+    void const *value;
+    unsigned len;
+
+    epoch_enter();
+    data = lru_shard_read(shard, ops, key, key_len, hash, count);
+    if (data) {
+        value = frames_data_value(data, &len);
+        memcpy(buf, value, len < size ? len : size);
+    }
+    epoch_exit();
+
+    return data ? (long) len : -1;
+}
+
+static unsigned lru_cache_hash(struct lru_cache *cache,
+                               void const *key, unsigned len)
+{
+    return hash_bytes(key, len, cache->seed);
+}
+
+static unsigned lru_shard_capacity(struct lru_cache *cache, unsigned i)
+{
+    return cache->capacity / cache->n_shards +
+           (i < cache->capacity % cache->n_shards);
+}
+
+static uint64_t lru_shard_budget(struct lru_cache *cache, unsigned i)
+{
+    return cache->attr.budget / cache->n_shards +
+           (i < cache->attr.budget % cache->n_shards);
+}
+
+/*
+ * The shard is chosen by the high bits of the hash multiplied again, so
+ * it does not correlate with the bits the hmap of the shard uses.
+ */
+static struct lru_shard *lru_cache_shard(struct lru_cache *cache,
+                                         unsigned hash)
+{
+    unsigned long long h = hash * 0x9e3779b1U;
+
+    return cache->shards + ((h * cache->n_shards) >> 32);
+}
+
+/*
+ * Lock a shard to change it.
+ *
+ * For lookups without locks, the count of changes is odd until the shard
+ * is unlocked with lru_cache_wrunlock().
+ */
+static void lru_cache_wrlock(struct lru_cache *cache, struct lru_shard *shard)
+{
+    if (!cache->locked)
+        return;
+
+    pthread_rwlock_wrlock(&shard->lock);
+    if (cache->lockless) {
+        __atomic_store_n(&shard->seq, shard->seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+
+    /* The policy sees the hits buffered before it chooses a victim. */
+    if (shard->rbufs)
+        lru_shard_drain(shard, cache->ops);
+}
+
+static void lru_cache_wrunlock(struct lru_cache *cache,
+                               struct lru_shard *shard)
+{
+    if (!cache->locked)
+        return;
+
+    if (cache->lockless) {
+        frames_reclaim(shard->frames);
+        __atomic_store_n(&shard->seq, shard->seq + 1, __ATOMIC_RELEASE);
+    }
+    pthread_rwlock_unlock(&shard->lock);
+}
+
+/* Lock a shard to look up and hit a key. */
+static void lru_cache_hitlock(struct lru_cache *cache, struct lru_shard *shard)
+{
+    if (!cache->locked)
+        return;
+
+    if (cache->ops->shared_hit || shard->rbufs)
+        pthread_rwlock_rdlock(&shard->lock);
+    else
+        pthread_rwlock_wrlock(&shard->lock);
+}
+
+static void lru_cache_rdlock(struct lru_cache *cache, struct lru_shard *shard)
+{
+    if (cache->locked)
+        pthread_rwlock_rdlock(&shard->lock);
+}
+
+static void lru_cache_unlock(struct lru_cache *cache, struct lru_shard *shard)
+{
+    if (cache->locked)
+        pthread_rwlock_unlock(&shard->lock);
+}
+
+/* Unlock a shard locked by lru_cache_hitlock(), drain its hits if due. */
+static void lru_cache_hitunlock(struct lru_cache *cache,
+                                struct lru_shard *shard)
+{
+    if (!cache->locked)
+        return;
+
+    pthread_rwlock_unlock(&shard->lock);
+    lru_shard_try_drain(shard, cache->ops);
+}
+
+struct lru_cache *lru_cache_alloc_attr(unsigned capacity,
+                                       struct lru_cache_attr const *attr)
+{
+    static struct lru_cache_attr const defaults = {
+        .policy = LRU_CACHE_POLICY_LRU,
+        .n_shards = 0,
+        .seed = 0,
+        .pages = LRU_CACHE_PAGES_DEFAULT,
+        .numa = LRU_CACHE_NUMA_DEFAULT,
+        .numa_node = 0,
+        .budget = 0,
+        .lockless = 0,
+        .buffered_hits = 0,
+    };
     struct lru_cache *cache = malloc(sizeof(*cache));
+    unsigned n_shards;
+    unsigned i;
+    int buffered;
+    int rc;
 
     die_on(!cache, "failed to allocate lru cache\n");
 
-    cache->frames = frames_alloc(capacity);
-    cache->lrul = lrul_alloc();
-    cache->hmap = hmap_alloc(capacity);
+    if (!attr)
+        attr = &defaults;
+
+    die_on((unsigned) attr->policy >= sizeof(lru_cache_policy_ops) /
+                                      sizeof(lru_cache_policy_ops[0]),
+           "invalid lru cache policy: %d\n", attr->policy);
+    cache->ops = lru_cache_policy_ops[attr->policy];
+    cache->locked = attr->n_shards > 0;
+    cache->lockless = cache->locked && attr->lockless;
+    /* Lookups without locks record the hits of the others in buffers. */
+    buffered = cache->locked && !cache->ops->shared_hit &&
+               (attr->buffered_hits || attr->lockless);
+    cache->capacity = capacity;
+    cache->attr = *attr;
+    cache->seed = attr->seed ? attr->seed : hash_seed();
+
+    BUILD_ASSERT((int) LRU_CACHE_PAGES_HUGETLB == (int) MEM_PAGES_HUGETLB);
+    BUILD_ASSERT((int) LRU_CACHE_NUMA_INTERLEAVE ==
+                 (int) MEM_NUMA_INTERLEAVE);
+    die_on(attr->pages > LRU_CACHE_PAGES_HUGETLB,
+           "invalid lru cache pages: %d\n", attr->pages);
+    die_on(attr->numa > LRU_CACHE_NUMA_INTERLEAVE,
+           "invalid lru cache NUMA placement: %d\n", attr->numa);
+    cache->mem.pages = (enum mem_pages) attr->pages;
+    cache->mem.numa = (enum mem_numa) attr->numa;
+    cache->mem.node = attr->numa_node;
+
+    n_shards = cache->locked ? attr->n_shards : 1;
+    die_on(n_shards > capacity,
+           "invalid number of lru cache shards: capacity %u, shards %u\n",
+           capacity, n_shards);
+
+    rc = posix_memalign((void **) &cache->shards, CACHE_LINE_SIZE,
+                        n_shards * sizeof(*cache->shards));
+    die_on(rc, "failed to allocate lru cache shards: %u\n", n_shards);
+
+    cache->n_shards = n_shards;
+
+    /* Spread the remainder of the capacity over the first shards. */
+    for (i = 0; i < n_shards; ++i)
+        lru_shard_init(cache->shards + i, cache->ops,
+                       lru_shard_capacity(cache, i),
+                       lru_shard_budget(cache, i), cache->lockless,
+                       buffered, &cache->mem);
 
     return cache;
 }
 
+struct lru_cache *lru_cache_alloc(unsigned capacity)
+{
+    return lru_cache_alloc_attr(capacity, NULL);
+}
+
+struct lru_cache *lru_cache_sharded_alloc(unsigned capacity, unsigned n_shards)
+{
+    struct lru_cache_attr attr = {
+        .policy = LRU_CACHE_POLICY_LRU,
+        .n_shards = n_shards,
+    };
+
+    die_on(!n_shards, "invalid number of lru cache shards: 0\n");
+
+    return lru_cache_alloc_attr(capacity, &attr);
+}
+
 void lru_cache_free(struct lru_cache *cache)
 {
-    hmap_free(cache->hmap);
-    lrul_free(cache->lrul);
-    frames_free(cache->frames);
+    unsigned i;
+
+    for (i = 0; i < cache->n_shards; ++i)
+        lru_shard_fini(cache->shards + i, cache->ops, &cache->mem);
+
+    free(cache->shards);
     free(cache);
 }
 
+void lru_cache_put_bytes(struct lru_cache *cache,
+                         void const *key, unsigned key_len,
+                         void const *value, unsigned value_len)
+{
+    unsigned hash = lru_cache_hash(cache, key, key_len);
+    struct lru_shard *shard = lru_cache_shard(cache, hash);
+
+    lru_cache_wrlock(cache, shard);
+    lru_shard_put(shard, cache->ops, key, key_len, hash, value, value_len, 0,
+                  LRU_WEIGHT_DATA);
+    lru_cache_wrunlock(cache, shard);
+}
+
+void lru_cache_put_bytes_weight(struct lru_cache *cache,
+                                void const *key, unsigned key_len,
+                                void const *value, unsigned value_len,
+                                unsigned weight)
+{
+    unsigned hash = lru_cache_hash(cache, key, key_len);
+    struct lru_shard *shard = lru_cache_shard(cache, hash);
+
+    lru_cache_wrlock(cache, shard);
+    lru_shard_put(shard, cache->ops, key, key_len, hash, value, value_len, 0,
+                  weight);
+    lru_cache_wrunlock(cache, shard);
+}
+
+void lru_cache_put_bytes_ttl(struct lru_cache *cache,
+                             void const *key, unsigned key_len,
+                             void const *value, unsigned value_len,
+                             unsigned ttl)
+{
+    unsigned hash = lru_cache_hash(cache, key, key_len);
+    struct lru_shard *shard = lru_cache_shard(cache, hash);
+    uint64_t expire = ttl ? lru_cache_now() + ttl : 0;
+    struct twheel *tw;
+
+    lru_cache_wrlock(cache, shard);
+    if (expire && !shard->ttl) {
+        tw = twheel_alloc(shard->capacity, lru_cache_now(), &cache->mem);
+        __atomic_store_n(&shard->ttl, tw, __ATOMIC_RELEASE);
+    }
+    lru_shard_put(shard, cache->ops, key, key_len, hash, value, value_len,
+                  expire, LRU_WEIGHT_DATA);
+    lru_cache_wrunlock(cache, shard);
+}
+
+int lru_cache_get_bytes(struct lru_cache *cache,
+                        void const *key, unsigned key_len,
+                        struct lru_cache_view *value)
+{
+    unsigned hash = lru_cache_hash(cache, key, key_len);
+    struct lru_shard *shard = lru_cache_shard(cache, hash);
+    void const *data;
+    unsigned idx;
+
+    if (cache->lockless) {
+        epoch_enter();
+        data = lru_shard_read(shard, cache->ops, key, key_len, hash, 1);
+        if (data)
+            value->data = frames_data_value(data, &value->len);
+        epoch_exit();
+        return data != NULL;
+    }
+
+    lru_cache_hitlock(cache, shard);
+    idx = lru_shard_get(shard, cache->ops, key, key_len, hash);
+    if (idx != HMAP_NONE)
+        value->data = frames_value(shard->frames, idx, &value->len);
+    lru_cache_hitunlock(cache, shard);
+
+    return idx != HMAP_NONE;
+}
+
+long lru_cache_copy_bytes(struct lru_cache *cache,
+                          void const *key, unsigned key_len,
+                          void *buf, unsigned size)
+{
+    unsigned hash = lru_cache_hash(cache, key, key_len);
+    struct lru_shard *shard = lru_cache_shard(cache, hash);
+    long len;
+
+    if (cache->lockless)
+        return lru_shard_read_copy(shard, cache->ops, key, key_len, hash, 1,
+                                   buf, size);
+
+    lru_cache_hitlock(cache, shard);
+    len = lru_shard_copy(shard,
+                         lru_shard_get(shard, cache->ops, key, key_len, hash),
+                         buf, size);
+    lru_cache_hitunlock(cache, shard);
+
+    return len;
+}
+
 void lru_cache_put(struct lru_cache *cache, int key, int value)
 {
-    struct hmap_item *hmap_item = hmap_get(cache->hmap, key);
-    struct lrul_item *lrul_item;
+    lru_cache_put_bytes(cache, &key, sizeof(key), &value, sizeof(value));
+}
 
-    if (hmap_item) {
-        lrul_rm_item(cache->lrul, hmap_item->lrul_item);
-    } else {
-        if (frames_all_used(cache->frames)) {
-            lrul_item = lrul_rm(cache->lrul);
-            hmap_item = lrul_item->hmap_item;
-            hmap_rm(cache->hmap, hmap_item);
-        } else {
-            hmap_item = hmap_item_alloc(cache->frames);
-            hmap_item->lrul_item = lrul_item_alloc(hmap_item);
+void lru_cache_put_ttl(struct lru_cache *cache, int key, int value,
+                       unsigned ttl)
+{
+    lru_cache_put_bytes_ttl(cache, &key, sizeof(key), &value, sizeof(value),
+                            ttl);
+}
+
+int lru_cache_get(struct lru_cache *cache, int key)
+{
+    int value;
+
+    if (lru_cache_copy_bytes(cache, &key, sizeof(key), &value,
+                             sizeof(value)) != sizeof(value))
+        return -1;
+
+    return value;
+}
+
+/*
+ * Look up a key under the hit lock, or without locks, and copy its int
+ * value.
+ *
+ * @param count Count the hit or the miss.
+ */
+static int lru_cache_get_int(struct lru_cache *cache, struct lru_shard *shard,
+                             int key, unsigned hash, int count, int *value)
+{
+    unsigned idx;
+    long len;
+
+    if (cache->lockless)
+        return lru_shard_read_copy(shard, cache->ops, &key, sizeof(key), hash,
+                                   count, value, sizeof(*value)) ==
+               sizeof(*value);
+
+    lru_cache_hitlock(cache, shard);
+    if (count)
+        idx = lru_shard_get(shard, cache->ops, &key, sizeof(key), hash);
+    else
+        idx = lru_shard_find(shard, cache->ops, &key, sizeof(key), hash);
+    len = lru_shard_copy(shard, idx, value, sizeof(*value));
+    lru_cache_hitunlock(cache, shard);
+
+    return len == sizeof(*value);
+}
+
+static struct lru_load *lru_shard_find_load(struct lru_shard *shard,
+                                            int key, unsigned hash)
+{
+    struct lru_load *load;
+
+    for (load = shard->loads; load; load = load->next) {
+        if (load->hash == hash && load->key == key)
+            return load;
+    }
+
+    return NULL;
+}
+
+static void lru_shard_rm_load(struct lru_shard *shard, struct lru_load *load)
+{
+    struct lru_load **p = &shard->loads;
+
+    while (*p != load)
+        p = &(*p)->next;
+
+    *p = load->next;
+}
+
+/*
+ * Load a value and cache it unless the load fails.
+ *
+ * The value is set only if the load succeeds, whatever the load leaves
+ * in its value otherwise.
+ */
+static int lru_cache_load_value(struct lru_cache *cache,
+                                struct lru_shard *shard,
+                                int key, unsigned hash,
+                                lru_cache_load_t load, void *ctx, int *value)
+{
+    int loaded;
+    int rc = load(ctx, key, &loaded);
+
+    __atomic_fetch_add(&shard->stats.loads, 1, __ATOMIC_RELAXED);
+
+    if (!rc) {
+        *value = loaded;
+        lru_cache_wrlock(cache, shard);
+        lru_shard_put(shard, cache->ops, &key, sizeof(key), hash,
+                      value, sizeof(*value), 0, LRU_WEIGHT_DATA);
+        lru_cache_wrunlock(cache, shard);
+    }
+
+    return rc;
+}
+
+/*
+ * A miss registers a load of the key in the shard unless there is one
+ * already, then it waits for that load. The cache is checked again under
+ * the load lock: a load caches its value before it is unregistered, so a
+ * miss finding no load either sees the value or loads it itself.
+ */
+int lru_cache_get_or_load(struct lru_cache *cache, int key,
+                          lru_cache_load_t load, void *ctx, int *value)
+{
+    unsigned hash = lru_cache_hash(cache, &key, sizeof(key));
+    struct lru_shard *shard = lru_cache_shard(cache, hash);
+    struct lru_load self;
+    struct lru_load *cur;
+    int rc;
+
+    if (lru_cache_get_int(cache, shard, key, hash, 1, value))
+        return 0;
+
+    if (!cache->locked)
+        return lru_cache_load_value(cache, shard, key, hash, load, ctx,
+                                    value);
+
+    pthread_mutex_lock(&shard->load_lock);
+
+    cur = lru_shard_find_load(shard, key, hash);
+    if (cur) {
+        __atomic_fetch_add(&shard->stats.coalesced, 1, __ATOMIC_RELAXED);
+        ++cur->n_waiters;
+        while (!cur->done)
+            pthread_cond_wait(&shard->load_cond, &shard->load_lock);
+        rc = cur->rc;
+        if (!rc)
+            *value = cur->value;
+        if (!--cur->n_waiters)
+            pthread_cond_broadcast(&shard->load_cond);
+        pthread_mutex_unlock(&shard->load_lock);
+        return rc;
+    }
+
+    /* The miss is counted already. */
+    if (lru_cache_get_int(cache, shard, key, hash, 0, value)) {
+        pthread_mutex_unlock(&shard->load_lock);
+        return 0;
+    }
+
+    self.key = key;
+    self.hash = hash;
+    self.n_waiters = 0;
+    self.done = 0;
+    self.next = shard->loads;
+    shard->loads = &self;
+    pthread_mutex_unlock(&shard->load_lock);
+
+    rc = lru_cache_load_value(cache, shard, key, hash, load, ctx, value);
+
+    pthread_mutex_lock(&shard->load_lock);
+    lru_shard_rm_load(shard, &self);
+    self.rc = rc;
+    if (!rc)
+        self.value = *value;
+    self.done = 1;
+    pthread_cond_broadcast(&shard->load_cond);
+    while (self.n_waiters)
+        pthread_cond_wait(&shard->load_cond, &shard->load_lock);
+    pthread_mutex_unlock(&shard->load_lock);
+
+    return rc;
+}
+
+/*
+ * Keys of a batch are processed in groups. The slots of a group are
+ * prefetched first, so the lookups of the group wait for memory at once
+ * instead of one after another.
+ */
+#define LRU_CACHE_GROUP 16U
+
+struct lru_cache_group {
+    struct lru_shard *shards[LRU_CACHE_GROUP];
+    unsigned hashes[LRU_CACHE_GROUP];
+    unsigned n;
+};
+
+static void lru_cache_group_prefetch(struct lru_cache *cache,
+                                     struct lru_cache_group *group,
+                                     int const *keys, unsigned n)
+{
+    unsigned i;
+
+    group->n = n < LRU_CACHE_GROUP ? n : LRU_CACHE_GROUP;
+
+    for (i = 0; i < group->n; ++i) {
+        group->hashes[i] = lru_cache_hash(cache, keys + i, sizeof(keys[i]));
+        group->shards[i] = lru_cache_shard(cache, group->hashes[i]);
+        hmap_prefetch(group->shards[i]->hmap, group->hashes[i]);
+    }
+}
+
+void lru_cache_get_many(struct lru_cache *cache, int const *keys, unsigned n,
+                        int *values)
+{
+    struct lru_cache_group group;
+    unsigned idxs[LRU_CACHE_GROUP];
+    struct lru_shard *shard;
+    unsigned i;
+
+    for (; n; keys += group.n, values += group.n, n -= group.n) {
+        lru_cache_group_prefetch(cache, &group, keys, n);
+
+        if (cache->lockless) {
+            for (i = 0; i < group.n; ++i) {
+                if (lru_shard_read_copy(group.shards[i], cache->ops, keys + i,
+                                        sizeof(keys[i]), group.hashes[i], 1,
+                                        values + i, sizeof(values[i])) !=
+                    sizeof(values[i]))
+                    values[i] = -1;
+            }
+            continue;
+        }
+
+        /*
+         * A frame found under the lock of a shard can be reused once the
+         * lock is released, so the locked lookups are not pipelined.
+         */
+        if (cache->locked) {
+            for (i = 0; i < group.n; ++i) {
+                shard = group.shards[i];
+                lru_cache_hitlock(cache, shard);
+                idxs[i] = lru_shard_get(shard, cache->ops, keys + i,
+                                        sizeof(keys[i]), group.hashes[i]);
+                if (lru_shard_copy(shard, idxs[i], values + i,
+                                   sizeof(values[i])) != sizeof(values[i]))
+                    values[i] = -1;
+                lru_cache_hitunlock(cache, shard);
+            }
+            continue;
+        }
+
+        /* Prefetch the frame information, then the keys and values. */
+        for (i = 0; i < group.n; ++i) {
+            shard = group.shards[i];
+            idxs[i] = hmap_peek(shard->hmap, group.hashes[i]);
+            if (idxs[i] != HMAP_NONE)
+                frames_prefetch(shard->frames, idxs[i]);
+        }
+
+        for (i = 0; i < group.n; ++i) {
+            if (idxs[i] != HMAP_NONE)
+                frames_prefetch_data(group.shards[i]->frames, idxs[i]);
         }
 
-        hmap_item->key = key;
-        hmap_add(cache->hmap, hmap_item);
+        for (i = 0; i < group.n; ++i) {
+            shard = group.shards[i];
+            idxs[i] = lru_shard_get(shard, cache->ops, keys + i,
+                                    sizeof(keys[i]), group.hashes[i]);
+            if (lru_shard_copy(shard, idxs[i], values + i,
+                               sizeof(values[i])) != sizeof(values[i]))
+                values[i] = -1;
+        }
     }
+}
+
+void lru_cache_put_many(struct lru_cache *cache, int const *keys, unsigned n,
+                        int const *values)
+{
+    struct lru_cache_group group;
+    struct lru_shard *shard;
+    unsigned i;
 
-    lrul_add(cache->lrul, hmap_item->lrul_item);
-    *frames_ref(cache->frames, hmap_item->frame_idx) = value;
+    for (; n; keys += group.n, values += group.n, n -= group.n) {
+        lru_cache_group_prefetch(cache, &group, keys, n);
+
+        /* A put may evict the key of the next one, so they run in turn. */
+        for (i = 0; i < group.n; ++i) {
+            shard = group.shards[i];
+            lru_cache_wrlock(cache, shard);
+            lru_shard_put(shard, cache->ops, keys + i, sizeof(keys[i]),
+                          group.hashes[i], values + i, sizeof(values[i]), 0,
+                          LRU_WEIGHT_DATA);
+            lru_cache_wrunlock(cache, shard);
+        }
+    }
 }
 
-int lru_cache_get(struct lru_cache *cache, int key)
+/*
+ * Change the number of frames of a shard under the exclusive lock.
+ *
+ * The keys are taken in the order of the policy: the keys to reuse first
+ * are evicted if there are more keys than frames, the others keep their
+ * frames unless the frames are past the new capacity, and they are added
+ * to a new policy and timing wheel in that order, as a snapshot is loaded.
+ * The hash map moves the keys to a table of the new size by the following
+ * puts.
+ */
+static void lru_shard_resize(struct lru_shard *shard,
+                             struct policy_ops const *ops, unsigned capacity,
+                             struct mem_attr const *mem)
 {
-    struct hmap_item *hmap_item = hmap_get(cache->hmap, key);
+    unsigned n = frames_used(shard->frames);
+    unsigned n_evict = n > capacity ? n - capacity : 0;
+    unsigned *weights = NULL;
+    uint64_t *expires = NULL;
+    unsigned *idxs;
+    unsigned *keep;
+    unsigned *to;
+    struct twheel *tw;
+    void *policy;
+    unsigned i;
+
+    idxs = malloc((n + 1) * sizeof(*idxs));
+    die_on(!idxs, "failed to allocate lru cache resize order\n");
+    ops->order(shard->policy, idxs, n);
 
-    if (!hmap_item)
+    for (i = 0; i < n_evict; ++i)
+        lru_shard_release(shard, idxs[i]);
+    shard->stats.evictions += n_evict;
+
+    keep = idxs + n_evict;
+    n -= n_evict;
+
+    to = malloc((n + 1) * sizeof(*to));
+    die_on(!to, "failed to allocate lru cache resize frames\n");
+
+    if (shard->ttl) {
+        expires = malloc((n + 1) * sizeof(*expires));
+        die_on(!expires, "failed to allocate lru cache resize TTLs\n");
+        for (i = 0; i < n; ++i)
+            expires[i] = twheel_expire(shard->ttl, keep[i]);
+    }
+
+    frames_resize(shard->frames, capacity, keep, n, to);
+
+    if (shard->weights) {
+        weights = mem_alloc(capacity * sizeof(*weights), mem);
+        memcpy(weights, shard->weights,
+               (capacity < shard->capacity ? capacity : shard->capacity) *
+               sizeof(*weights));
+    }
+
+    for (i = 0; i < n; ++i) {
+        if (to[i] == keep[i])
+            continue;
+        hmap_move(shard->hmap, keep[i], to[i]);
+        if (weights)
+            weights[to[i]] = shard->weights[keep[i]];
+    }
+
+    hmap_resize(shard->hmap, capacity);
+
+    policy = ops->alloc(capacity, mem);
+    for (i = 0; i < n; ++i)
+        ops->add(policy, to[i], hmap_hash(shard->hmap, to[i]));
+    ops->free(shard->policy);
+    shard->policy = policy;
+
+    if (expires) {
+        tw = twheel_alloc(capacity, lru_cache_now(), mem);
+        for (i = 0; i < n; ++i) {
+            if (expires[i])
+                twheel_add(tw, to[i], expires[i]);
+        }
+        twheel_free(shard->ttl);
+        shard->ttl = tw;
+    }
+
+    if (weights) {
+        mem_free(shard->weights, shard->capacity * sizeof(*weights), mem);
+        shard->weights = weights;
+    }
+
+    shard->capacity = capacity;
+
+    free(expires);
+    free(to);
+    free(idxs);
+}
+
+/*
+ * A shard is resized under its exclusive lock. Lookups without locks are
+ * sent to the shared lock first, and the resize waits for the lookups
+ * started before to finish, so none reads the memory it frees.
+ */
+void lru_cache_resize(struct lru_cache *cache, unsigned capacity)
+{
+    struct lru_shard *shard;
+    unsigned i;
+
+    die_on(capacity < cache->n_shards,
+           "invalid lru cache capacity: capacity %u, shards %u\n",
+           capacity, cache->n_shards);
+
+    cache->capacity = capacity;
+
+    for (i = 0; i < cache->n_shards; ++i) {
+        shard = cache->shards + i;
+
+        if (cache->lockless) {
+            __atomic_store_n(&shard->resizing, 1, __ATOMIC_SEQ_CST);
+            epoch_synchronize();
+        }
+
+        lru_cache_wrlock(cache, shard);
+        lru_shard_resize(shard, cache->ops, lru_shard_capacity(cache, i),
+                         &cache->mem);
+        lru_cache_wrunlock(cache, shard);
+
+        if (cache->lockless)
+            __atomic_store_n(&shard->resizing, 0, __ATOMIC_RELEASE);
+    }
+}
+
+void lru_cache_stats(struct lru_cache *cache, struct lru_cache_stats *stats)
+{
+    struct lru_shard *shard;
+    struct hmap_stats hs;
+    unsigned i, j;
+
+    BUILD_ASSERT(LRU_CACHE_STATS_PROBES == HMAP_STATS_PROBES);
+
+    memset(stats, 0, sizeof(*stats));
+
+    for (i = 0; i < cache->n_shards; ++i) {
+        shard = cache->shards + i;
+
+        lru_cache_rdlock(cache, shard);
+        stats->hits += __atomic_load_n(&shard->stats.hits, __ATOMIC_RELAXED);
+        stats->misses += __atomic_load_n(&shard->stats.misses,
+                                         __ATOMIC_RELAXED);
+        stats->inserts += shard->stats.inserts;
+        stats->updates += shard->stats.updates;
+        stats->evictions += shard->stats.evictions;
+        stats->expirations += shard->stats.expirations;
+        stats->loads += __atomic_load_n(&shard->stats.loads,
+                                        __ATOMIC_RELAXED);
+        stats->coalesced += __atomic_load_n(&shard->stats.coalesced,
+                                            __ATOMIC_RELAXED);
+        stats->hits_dropped += __atomic_load_n(&shard->stats.hits_dropped,
+                                               __ATOMIC_RELAXED);
+        stats->weight += shard->weight;
+        hmap_stats(shard->hmap, &hs);
+        lru_cache_unlock(cache, shard);
+
+        stats->n_slots += hs.n_slots;
+        stats->n_used += hs.n_used;
+        stats->n_deleted += hs.n_deleted;
+        for (j = 0; j < LRU_CACHE_STATS_PROBES; ++j)
+            stats->probes[j] += hs.probes[j];
+    }
+}
+
+/*
+ * A snapshot is a header and the keys of every shard in turn, in the order
+ * of the policy to reuse their frames. A key is a record with its hash,
+ * then the key bytes and the value bytes padded to the record alignment.
+ *
+ * The records are in the host byte order, so a snapshot is loaded from a
+ * mapping of the file: every record is copied into a frame, added to the
+ * policy and to the hash map with no lookups.
+ */
+#define LRU_SNAP_MAGIC "LRUSNAP"
+#define LRU_SNAP_VERSION 4U
+
+struct lru_snap_hdr {
+    char magic[8];
+    uint32_t version;
+    uint32_t policy;
+    uint32_t n_shards;
+    uint32_t capacity;
+    /** The seed the hashes of the records are made with. */
+    uint64_t seed;
+    uint64_t budget;
+    uint32_t pages;
+    uint32_t numa;
+    uint32_t numa_node;
+    /** LRU_SNAP_LOCKLESS and LRU_SNAP_BUFFERED_HITS. */
+    uint32_t flags;
+};
+
+#define LRU_SNAP_LOCKLESS 0x1U
+#define LRU_SNAP_BUFFERED_HITS 0x2U
+
+struct lru_snap_shard {
+    /** The number of records of the shard. */
+    uint32_t n;
+};
+
+struct lru_snap_rec {
+    uint32_t hash;
+    uint32_t key_len;
+    uint32_t value_len;
+    /** The weight of the key for a cache with a budget or 0. */
+    uint32_t weight;
+};
+
+#define LRU_SNAP_ALIGN sizeof(uint32_t)
+
+static size_t lru_snap_rec_size(size_t key_len, size_t value_len)
+{
+    size_t size = sizeof(struct lru_snap_rec) + key_len + value_len;
+
+    return (size + LRU_SNAP_ALIGN - 1) & ~(LRU_SNAP_ALIGN - 1);
+}
+
+/*
+ * Save the records of a shard.
+ *
+ * @param idxs The buffer of the order of the frames, grown as needed.
+ * @param n_idxs The size of the buffer.
+ */
+static int lru_shard_save(struct lru_cache *cache, struct lru_shard *shard,
+                          unsigned **idxs, unsigned *n_idxs, FILE *fp)
+{
+    static char const pad[LRU_SNAP_ALIGN];
+    struct lru_snap_shard sh;
+    struct lru_snap_rec rec;
+    void const *key;
+    void const *value;
+    size_t pad_len;
+    unsigned *order;
+    unsigned n;
+    unsigned i;
+
+    /* The shards may be resized since the order is allocated. */
+    n = frames_used(shard->frames);
+    if (n > *n_idxs) {
+        free(*idxs);
+        *idxs = malloc(n * sizeof(**idxs));
+        die_on(!*idxs, "failed to allocate lru cache snapshot order\n");
+        *n_idxs = n;
+    }
+    order = *idxs;
+    cache->ops->order(shard->policy, order, n);
+
+    /* Keys with a TTL are not saved, they would outlive it. */
+    for (i = 0, sh.n = 0; i < n; ++i) {
+        if (!shard->ttl || !twheel_expire(shard->ttl, order[i]))
+            order[sh.n++] = order[i];
+    }
+
+    if (fwrite(&sh, sizeof(sh), 1, fp) != 1)
         return -1;
 
-    lrul_rm_item(cache->lrul, hmap_item->lrul_item);
-    lrul_add(cache->lrul, hmap_item->lrul_item);
+    for (i = 0; i < sh.n; ++i) {
+        key = frames_key(shard->frames, order[i], &rec.key_len);
+        value = frames_value(shard->frames, order[i], &rec.value_len);
+        rec.hash = lru_cache_hash(cache, key, rec.key_len);
+        rec.weight = shard->weights ? shard->weights[order[i]] : 0;
+        pad_len = lru_snap_rec_size(rec.key_len, rec.value_len) -
+                  sizeof(rec) - rec.key_len - rec.value_len;
 
-    return *frames_ref(cache->frames, hmap_item->frame_idx);
+        if (fwrite(&rec, sizeof(rec), 1, fp) != 1 ||
+            fwrite(key, 1, rec.key_len, fp) != rec.key_len ||
+            fwrite(value, 1, rec.value_len, fp) != rec.value_len ||
+            fwrite(pad, 1, pad_len, fp) != pad_len)
+            return -1;
+    }
+
+    return 0;
+}
+
+int lru_cache_save(struct lru_cache *cache, char const *path)
+{
+    struct lru_snap_hdr hdr;
+    struct lru_shard *shard;
+    size_t len = strlen(path);
+    unsigned *idxs = NULL;
+    unsigned n_idxs = 0;
+    char *tmp;
+    FILE *fp;
+    unsigned i;
+    int rc = 0;
+
+    /* A save is written aside, so a failed one keeps the previous one. */
+    tmp = malloc(len + sizeof(".tmp"));
+    die_on(!tmp, "failed to allocate lru cache snapshot path\n");
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".tmp", sizeof(".tmp"));
+
+    fp = fopen(tmp, "w");
+    if (!fp) {
+        free(tmp);
+        return -1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, LRU_SNAP_MAGIC, sizeof(LRU_SNAP_MAGIC));
+    hdr.version = LRU_SNAP_VERSION;
+    hdr.policy = cache->attr.policy;
+    hdr.n_shards = cache->attr.n_shards;
+    hdr.capacity = cache->capacity;
+    hdr.seed = cache->seed;
+    hdr.budget = cache->attr.budget;
+    hdr.pages = cache->attr.pages;
+    hdr.numa = cache->attr.numa;
+    hdr.numa_node = cache->attr.numa_node;
+    hdr.flags = (cache->attr.lockless ? LRU_SNAP_LOCKLESS : 0) |
+                (cache->attr.buffered_hits ? LRU_SNAP_BUFFERED_HITS : 0);
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+        rc = -1;
+
+    for (i = 0; !rc && i < cache->n_shards; ++i) {
+        shard = cache->shards + i;
+
+        /* A shared lock keeps the order, hits under it do not change it. */
+        lru_cache_rdlock(cache, shard);
+        rc = lru_shard_save(cache, shard, &idxs, &n_idxs, fp);
+        lru_cache_unlock(cache, shard);
+    }
+
+    if (fclose(fp))
+        rc = -1;
+    if (!rc)
+        rc = rename(tmp, path);
+    if (rc)
+        unlink(tmp);
+
+    free(idxs);
+    free(tmp);
+
+    return rc;
+}
+
+/*
+ * Load the records of a shard.
+ *
+ * @param p The records of the shard, advanced past them.
+ * @param end The end of the snapshot.
+ * @retval 0 on success or -1 if the records are malformed.
+ */
+static int lru_shard_load(struct lru_shard *shard,
+                          struct policy_ops const *ops, unsigned capacity,
+                          char const **p, char const *end)
+{
+    struct lru_snap_shard const *sh = (struct lru_snap_shard const *) *p;
+    struct lru_snap_rec const *rec;
+    char const *key;
+    size_t size;
+    unsigned idx;
+    unsigned i;
+
+    if ((size_t) (end - *p) < sizeof(*sh) || sh->n > capacity)
+        return -1;
+
+    *p += sizeof(*sh);
+
+    for (i = 0; i < sh->n; ++i) {
+        rec = (struct lru_snap_rec const *) *p;
+        if ((size_t) (end - *p) < sizeof(*rec))
+            return -1;
+
+        size = lru_snap_rec_size(rec->key_len, rec->value_len);
+        if ((size_t) (end - *p) < size)
+            return -1;
+
+        key = (char const *) (rec + 1);
+        idx = frames_reserve(shard->frames);
+        frames_set(shard->frames, idx, key, rec->key_len,
+                   key + rec->key_len, rec->value_len);
+        hmap_add(shard->hmap, rec->hash, idx);
+        ops->add(shard->policy, idx, rec->hash);
+        if (shard->weights) {
+            shard->weights[idx] = rec->weight;
+            shard->weight += rec->weight;
+        }
+
+        *p += size;
+    }
+
+    return 0;
+}
+
+struct lru_cache *lru_cache_load(char const *path)
+{
+    struct lru_snap_hdr const *hdr;
+    struct lru_cache_attr attr;
+    struct lru_cache *cache = NULL;
+    char const *p;
+    char const *end;
+    struct stat st;
+    void *map;
+    unsigned i;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st) || (size_t) st.st_size < sizeof(*hdr)) {
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    hdr = map;
+    p = (char const *) (hdr + 1);
+    end = (char const *) map + st.st_size;
+
+    if (memcmp(hdr->magic, LRU_SNAP_MAGIC, sizeof(LRU_SNAP_MAGIC)) ||
+        hdr->version != LRU_SNAP_VERSION ||
+        hdr->policy >= sizeof(lru_cache_policy_ops) /
+                       sizeof(lru_cache_policy_ops[0]) ||
+        !hdr->capacity || hdr->n_shards > hdr->capacity ||
+        hdr->pages > LRU_CACHE_PAGES_HUGETLB ||
+        hdr->numa > LRU_CACHE_NUMA_INTERLEAVE)
+        goto out;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.policy = hdr->policy;
+    attr.n_shards = hdr->n_shards;
+    attr.seed = hdr->seed;
+    attr.budget = hdr->budget;
+    attr.pages = (enum lru_cache_pages) hdr->pages;
+    attr.numa = (enum lru_cache_numa) hdr->numa;
+    attr.numa_node = hdr->numa_node;
+    attr.lockless = !!(hdr->flags & LRU_SNAP_LOCKLESS);
+    attr.buffered_hits = !!(hdr->flags & LRU_SNAP_BUFFERED_HITS);
+    cache = lru_cache_alloc_attr(hdr->capacity, &attr);
+
+    /* The shard of a key depends on the number of shards only. */
+    for (i = 0; i < cache->n_shards; ++i) {
+        if (lru_shard_load(cache->shards + i, cache->ops,
+                           lru_shard_capacity(cache, i), &p, end))
+            break;
+    }
+
+    if (i < cache->n_shards || p != end) {
+        lru_cache_free(cache);
+        cache = NULL;
+    }
+
+out:
+    munmap(map, st.st_size);
+
+    return cache;
 }
@@ -7,58 +7,124 @@
  */
 #include <stdlib.h>
 #include "lru_cache/log.h"
+#include "lru_cache/mem.h"
 #include "lru_cache/lrul.h"
 
+/*
+ * The lists are circular and linked by indexes.
+ *
+ * The item for the frame i is items[i], and items[capacity + l] is the
+ * head of the list l. So, no item is allocated on the list changes.
+ */
+
+/** The LRU information on a frame. */
+struct lrul_item {
+    unsigned prev;
+    unsigned next;
+};
+
 struct lrul {
-    CIRCLEQ_HEAD(, lrul_item) head;
+    struct lrul_item *items;
+    unsigned capacity;
+    unsigned n_lists;
+    struct mem_attr mem;
 };
 
-struct lrul_item *lrul_item_alloc(struct hmap_item *hmap_item)
+struct lrul *lrul_alloc(unsigned capacity, unsigned n_lists,
+                        struct mem_attr const *mem)
 {
-    struct lrul_item *item = malloc(sizeof(*item));
+    struct lrul *lrul = calloc(1, sizeof(*lrul));
+    unsigned head;
+
+    die_on(!lrul, "failed to allocate LRU list\n");
 
-    die_on(!item, "failed to allocate LRU list item\n");
-    item->hmap_item = hmap_item;
+    if (mem)
+        lrul->mem = *mem;
 
-    return item;
+    lrul->items = mem_alloc((capacity + n_lists) * sizeof(*lrul->items),
+                            &lrul->mem);
+    lrul->capacity = capacity;
+    lrul->n_lists = n_lists;
+
+    for (head = capacity; head < capacity + n_lists; ++head) {
+        lrul->items[head].prev = head;
+        lrul->items[head].next = head;
+    }
+
+    return lrul;
 }
 
-void lrul_item_free(struct lrul_item *item)
+void lrul_free(struct lrul *lrul)
 {
-    free(item);
+    mem_free(lrul->items,
+             (lrul->capacity + lrul->n_lists) * sizeof(*lrul->items),
+             &lrul->mem);
+    free(lrul);
 }
 
-struct lrul *lrul_alloc(void)
+void lrul_add(struct lrul *lrul, unsigned list, unsigned idx)
 {
-    struct lrul *lrul = malloc(sizeof(*lrul));
+    unsigned h = lrul->capacity + list;
+    struct lrul_item *head = lrul->items + h;
 
-    die_on(!lrul, "failed to allocate LRU list\n");
+    ASSERT(list < lrul->n_lists);
 
-    CIRCLEQ_INIT(&lrul->head);
+    lrul->items[idx].prev = h;
+    lrul->items[idx].next = head->next;
+    lrul->items[head->next].prev = idx;
+    head->next = idx;
+}
 
-    return lrul;
+unsigned lrul_rm(struct lrul *lrul, unsigned list)
+{
+    unsigned idx = lrul_tail(lrul, list);
+
+    ASSERT(idx != LRUL_NONE);
+
+    lrul_rm_item(lrul, idx);
+
+    return idx;
 }
 
-void lrul_free(struct lrul *lrul)
+void lrul_rm_item(struct lrul *lrul, unsigned idx)
 {
-    free(lrul);
+    struct lrul_item *item = lrul->items + idx;
+
+    lrul->items[item->prev].next = item->next;
+    lrul->items[item->next].prev = item->prev;
 }
 
-void lrul_add(struct lrul *lrul, struct lrul_item *item)
+unsigned lrul_tail(struct lrul *lrul, unsigned list)
 {
-    CIRCLEQ_INSERT_HEAD(&lrul->head, item, next);
+    unsigned h = lrul->capacity + list;
+    unsigned idx = lrul->items[h].prev;
+
+    ASSERT(list < lrul->n_lists);
+
+    return idx != h ? idx : LRUL_NONE;
 }
 
-struct lrul_item *lrul_rm(struct lrul *lrul)
+unsigned lrul_tail_skip(struct lrul *lrul, unsigned list, unsigned skip)
 {
-    struct lrul_item *item = CIRCLEQ_LAST(&lrul->head);
+    unsigned idx = lrul_tail(lrul, list);
 
-    CIRCLEQ_REMOVE(&lrul->head, item, next);
+    if (idx == skip && idx != LRUL_NONE) {
+        idx = lrul->items[idx].prev;
+        if (idx == lrul->capacity + list)
+            idx = LRUL_NONE;
+    }
 
-    return item;
+    return idx;
 }
 
-void lrul_rm_item(struct lrul *lrul, struct lrul_item *item)
+void lrul_order(struct lrul *lrul, unsigned list, unsigned *idxs,
+                unsigned n)
 {
-    CIRCLEQ_REMOVE(&lrul->head, item, next);
+    unsigned h = lrul->capacity + list;
+    unsigned idx = lrul->items[h].prev;
+
+    for (; n && idx != h; --n, idx = lrul->items[idx].prev)
+        *idxs++ = idx;
+
+    ASSERT(!n);
 }
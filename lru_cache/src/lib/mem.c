@@ -0,0 +1,183 @@
+/**
+ * @file
+ * Backing memory for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "lru_cache/log.h"
+#include "lru_cache/mem.h"
+
+/*
+ * Memory with non-default attributes is mapped. A mapping of huge pages
+ * is aligned to a huge page, so transparent huge pages back all of it.
+ * Its length depends on the size and the attributes only, so it is not
+ * kept to unmap it.
+ *
+ * NUMA placement is set with mbind() before the pages are touched. There
+ * is no glibc wrapper for it, so libnuma is not needed.
+ */
+
+/* Values of linux/mempolicy.h. */
+#define MEM_MPOL_BIND 2
+#define MEM_MPOL_INTERLEAVE 3
+#define MEM_MPOL_F_MEMS_ALLOWED 4
+
+/* The kernel takes one bit less than the number of nodes passed. */
+#define MEM_MAXNODE (8 * sizeof(unsigned long) + 1)
+
+static int mem_is_default(struct mem_attr const *attr)
+{
+    return !attr || (attr->pages == MEM_PAGES_DEFAULT &&
+                     attr->numa == MEM_NUMA_DEFAULT);
+}
+
+static int mem_is_huge(size_t size, struct mem_attr const *attr)
+{
+    return attr->pages != MEM_PAGES_DEFAULT && size >= MEM_HUGE_PAGE_SIZE;
+}
+
+static size_t mem_len(size_t size, struct mem_attr const *attr)
+{
+    size_t page = mem_is_huge(size, attr) ? MEM_HUGE_PAGE_SIZE :
+                                            (size_t) sysconf(_SC_PAGESIZE);
+
+    return (size + page - 1) & ~(page - 1);
+}
+
+/*
+ * Map anonymous memory aligned to a power of 2 larger than a page or to
+ * a page for 0.
+ */
+static void *mem_map(size_t len, size_t align)
+{
+    char *p = mmap(NULL, len + align, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    size_t head;
+
+    if (p == MAP_FAILED)
+        return NULL;
+    if (!align)
+        return p;
+
+    head = -(uintptr_t) p & (align - 1);
+    if (head)
+        munmap(p, head);
+    munmap(p + head + len, align - head);
+
+    return p + head;
+}
+
+static void mem_bind(void *p, size_t len, struct mem_attr const *attr)
+{
+#ifdef SYS_mbind
+    unsigned long mask = 0;
+    int mode;
+    long rc;
+
+    switch (attr->numa) {
+    case MEM_NUMA_BIND:
+        if (attr->node >= MEM_MAXNODE - 1)
+            return;
+        mask = 1UL << attr->node;
+        mode = MEM_MPOL_BIND;
+        break;
+    case MEM_NUMA_INTERLEAVE:
+        if (syscall(SYS_get_mempolicy, NULL, &mask, MEM_MAXNODE, NULL,
+                    MEM_MPOL_F_MEMS_ALLOWED))
+            return;
+        mode = MEM_MPOL_INTERLEAVE;
+        break;
+    default:
+        return;
+    }
+
+    rc = syscall(SYS_mbind, p, len, mode, &mask, MEM_MAXNODE, 0);
+    DPRINT(rc, "mem: failed to set NUMA policy %d of %zu bytes\n",
+           mode, len);
+    (void) rc;
+#else
+    (void) p;
+    (void) len;
+    (void) attr;
+#endif
+}
+
+void *mem_alloc_aligned(size_t size, size_t align,
+                        struct mem_attr const *attr)
+{
+    void *p = NULL;
+    size_t len;
+
+    ASSERT(!(align & (align - 1)) && align <= MEM_HUGE_PAGE_SIZE);
+
+    if (mem_is_default(attr)) {
+        if (align <= sizeof(void *))
+            p = malloc(size);
+        else if (posix_memalign(&p, align, size))
+            p = NULL;
+        die_on(!p, "failed to allocate memory: %zu bytes\n", size);
+        return p;
+    }
+
+    if (align <= (size_t) sysconf(_SC_PAGESIZE))
+        align = 0;
+
+    len = mem_len(size, attr);
+
+#ifdef MAP_HUGETLB
+    if (attr->pages == MEM_PAGES_HUGETLB && mem_is_huge(size, attr)) {
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED)
+            p = NULL;
+    }
+#endif
+
+    if (!p && mem_is_huge(size, attr)) {
+        p = mem_map(len, MEM_HUGE_PAGE_SIZE);
+#ifdef MADV_HUGEPAGE
+        if (p)
+            madvise(p, len, MADV_HUGEPAGE);
+#endif
+    } else if (!p) {
+        p = mem_map(len, align);
+    }
+
+    die_on(!p, "failed to map memory: %zu bytes\n", size);
+
+    mem_bind(p, len, attr);
+
+    return p;
+}
+
+void *mem_alloc(size_t size, struct mem_attr const *attr)
+{
+    return mem_alloc_aligned(size, 0, attr);
+}
+
+void *mem_zalloc(size_t size, struct mem_attr const *attr)
+{
+    void *p;
+
+    if (!mem_is_default(attr))
+        return mem_alloc(size, attr);
+
+    p = calloc(1, size);
+    die_on(!p, "failed to allocate memory: %zu bytes\n", size);
+
+    return p;
+}
+
+void mem_free(void *p, size_t size, struct mem_attr const *attr)
+{
+    if (mem_is_default(attr))
+        free(p);
+    else if (p)
+        munmap(p, mem_len(size, attr));
+}
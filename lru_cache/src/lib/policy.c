@@ -0,0 +1,258 @@
+/**
+ * @file
+ * Frame replacement policies for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include "lru_cache/arc.h"
+#include "lru_cache/log.h"
+#include "lru_cache/lrul.h"
+#include "lru_cache/sclk.h"
+#include "lru_cache/slru.h"
+#include "lru_cache/wtlfu.h"
+#include "lru_cache/policy.h"
+
+static void *policy_lru_alloc(unsigned capacity, struct mem_attr const *mem)
+{
+    /* The policies pass the frame to skip as it is. */
+    BUILD_ASSERT(POLICY_NONE == LRUL_NONE);
+    BUILD_ASSERT(POLICY_NONE == SCLK_NONE);
+
+    return lrul_alloc(capacity, 1, mem);
+}
+
+static void policy_lru_free(void *policy)
+{
+    lrul_free(policy);
+}
+
+static void policy_lru_add(void *policy, unsigned idx, unsigned hash)
+{
+    (void) hash;
+    lrul_add(policy, 0, idx);
+}
+
+static void policy_lru_hit(void *policy, unsigned idx)
+{
+    lrul_rm_item(policy, idx);
+    lrul_add(policy, 0, idx);
+}
+
+static unsigned policy_lru_rm(void *policy, unsigned skip)
+{
+    unsigned idx = lrul_tail_skip(policy, 0, skip);
+
+    lrul_rm_item(policy, idx);
+
+    return idx;
+}
+
+static void policy_lru_rm_item(void *policy, unsigned idx)
+{
+    lrul_rm_item(policy, idx);
+}
+
+static void policy_lru_order(void *policy, unsigned *idxs, unsigned n)
+{
+    lrul_order(policy, 0, idxs, n);
+}
+
+struct policy_ops const policy_lru_ops = {
+    .alloc = policy_lru_alloc,
+    .free = policy_lru_free,
+    .add = policy_lru_add,
+    .hit = policy_lru_hit,
+    .rm = policy_lru_rm,
+    .rm_item = policy_lru_rm_item,
+    .order = policy_lru_order,
+    .shared_hit = 0,
+};
+
+static void *policy_clock_alloc(unsigned capacity,
+                                struct mem_attr const *mem)
+{
+    return sclk_alloc(capacity, mem);
+}
+
+static void policy_clock_free(void *policy)
+{
+    sclk_free(policy);
+}
+
+static void policy_clock_add(void *policy, unsigned idx, unsigned hash)
+{
+    (void) hash;
+    sclk_add(policy, idx);
+}
+
+static void policy_clock_hit(void *policy, unsigned idx)
+{
+    sclk_ref(policy, idx);
+}
+
+static unsigned policy_clock_rm(void *policy, unsigned skip)
+{
+    return sclk_rm(policy, skip);
+}
+
+static void policy_clock_rm_item(void *policy, unsigned idx)
+{
+    sclk_rm_item(policy, idx);
+}
+
+static void policy_clock_order(void *policy, unsigned *idxs, unsigned n)
+{
+    sclk_order(policy, idxs, n);
+}
+
+struct policy_ops const policy_clock_ops = {
+    .alloc = policy_clock_alloc,
+    .free = policy_clock_free,
+    .add = policy_clock_add,
+    .hit = policy_clock_hit,
+    .rm = policy_clock_rm,
+    .rm_item = policy_clock_rm_item,
+    .order = policy_clock_order,
+    .shared_hit = 1,
+};
+
+static void *policy_slru_alloc(unsigned capacity, struct mem_attr const *mem)
+{
+    return slru_alloc(capacity, mem);
+}
+
+static void policy_slru_free(void *policy)
+{
+    slru_free(policy);
+}
+
+static void policy_slru_add(void *policy, unsigned idx, unsigned hash)
+{
+    (void) hash;
+    slru_add(policy, idx);
+}
+
+static void policy_slru_hit(void *policy, unsigned idx)
+{
+    slru_hit(policy, idx);
+}
+
+static unsigned policy_slru_rm(void *policy, unsigned skip)
+{
+    return slru_rm(policy, skip);
+}
+
+static void policy_slru_rm_item(void *policy, unsigned idx)
+{
+    slru_rm_item(policy, idx);
+}
+
+static void policy_slru_order(void *policy, unsigned *idxs, unsigned n)
+{
+    slru_order(policy, idxs, n);
+}
+
+struct policy_ops const policy_slru_ops = {
+    .alloc = policy_slru_alloc,
+    .free = policy_slru_free,
+    .add = policy_slru_add,
+    .hit = policy_slru_hit,
+    .rm = policy_slru_rm,
+    .rm_item = policy_slru_rm_item,
+    .order = policy_slru_order,
+    .shared_hit = 0,
+};
+
+static void *policy_tinylfu_alloc(unsigned capacity,
+                                  struct mem_attr const *mem)
+{
+    return wtlfu_alloc(capacity, mem);
+}
+
+static void policy_tinylfu_free(void *policy)
+{
+    wtlfu_free(policy);
+}
+
+static void policy_tinylfu_add(void *policy, unsigned idx, unsigned hash)
+{
+    wtlfu_add(policy, idx, hash);
+}
+
+static void policy_tinylfu_hit(void *policy, unsigned idx)
+{
+    wtlfu_hit(policy, idx);
+}
+
+static unsigned policy_tinylfu_rm(void *policy, unsigned skip)
+{
+    return wtlfu_rm(policy, skip);
+}
+
+static void policy_tinylfu_rm_item(void *policy, unsigned idx)
+{
+    wtlfu_rm_item(policy, idx);
+}
+
+static void policy_tinylfu_order(void *policy, unsigned *idxs, unsigned n)
+{
+    wtlfu_order(policy, idxs, n);
+}
+
+struct policy_ops const policy_tinylfu_ops = {
+    .alloc = policy_tinylfu_alloc,
+    .free = policy_tinylfu_free,
+    .add = policy_tinylfu_add,
+    .hit = policy_tinylfu_hit,
+    .rm = policy_tinylfu_rm,
+    .rm_item = policy_tinylfu_rm_item,
+    .order = policy_tinylfu_order,
+    .shared_hit = 0,
+};
+
+static void *policy_arc_alloc(unsigned capacity, struct mem_attr const *mem)
+{
+    return arc_alloc(capacity, mem);
+}
+
+static void policy_arc_free(void *policy)
+{
+    arc_free(policy);
+}
+
+static void policy_arc_add(void *policy, unsigned idx, unsigned hash)
+{
+    arc_add(policy, idx, hash);
+}
+
+static void policy_arc_hit(void *policy, unsigned idx)
+{
+    arc_hit(policy, idx);
+}
+
+static unsigned policy_arc_rm(void *policy, unsigned skip)
+{
+    return arc_rm(policy, skip);
+}
+
+static void policy_arc_rm_item(void *policy, unsigned idx)
+{
+    arc_rm_item(policy, idx);
+}
+
+static void policy_arc_order(void *policy, unsigned *idxs, unsigned n)
+{
+    arc_order(policy, idxs, n);
+}
+
+struct policy_ops const policy_arc_ops = {
+    .alloc = policy_arc_alloc,
+    .free = policy_arc_free,
+    .add = policy_arc_add,
+    .hit = policy_arc_hit,
+    .rm = policy_arc_rm,
+    .rm_item = policy_arc_rm_item,
+    .order = policy_arc_order,
+    .shared_hit = 0,
+};
@@ -0,0 +1,137 @@
+/**
+ * @file
+ * Second chance CLOCK for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "lru_cache/log.h"
+#include "lru_cache/mem.h"
+#include "lru_cache/sclk.h"
+
+/*
+ * Every frame has a reference bit. The hand sweeps over the frames and
+ * clears the bits, the first frame found with the bit cleared already
+ * is the victim.
+ *
+ * A reference only sets a byte, so it does not need an exclusive access
+ * to the clock, nor any lock for lookups without locks. The bits are
+ * accessed atomically for that.
+ *
+ * Frames not added or removed are marked absent, the hand skips them.
+ */
+#define SCLK_ABSENT 2
+
+struct sclk {
+    unsigned char *refs;
+    unsigned capacity;
+    unsigned hand;
+    struct mem_attr mem;
+};
+
+struct sclk *sclk_alloc(unsigned capacity, struct mem_attr const *mem)
+{
+    struct sclk *sclk = calloc(1, sizeof(*sclk));
+
+    die_on(!sclk, "failed to allocate clock\n");
+
+    if (mem)
+        sclk->mem = *mem;
+
+    sclk->refs = mem_alloc(capacity * sizeof(*sclk->refs), &sclk->mem);
+    memset(sclk->refs, SCLK_ABSENT, capacity * sizeof(*sclk->refs));
+
+    sclk->capacity = capacity;
+    sclk->hand = 0;
+
+    return sclk;
+}
+
+void sclk_free(struct sclk *sclk)
+{
+    mem_free(sclk->refs, sclk->capacity * sizeof(*sclk->refs), &sclk->mem);
+    free(sclk);
+}
+
+void sclk_add(struct sclk *sclk, unsigned idx)
+{
+    __atomic_store_n(sclk->refs + idx, 0, __ATOMIC_RELAXED);
+}
+
+void sclk_ref(struct sclk *sclk, unsigned idx)
+{
+    unsigned char ref = 0;
+
+    /*
+     * Do not dirty the line if the bit is set already. The bit is set only
+     * if it is clear, a reference racing with the removal of the frame
+     * does not make it present again.
+     */
+    if (!__atomic_load_n(sclk->refs + idx, __ATOMIC_RELAXED))
+        __atomic_compare_exchange_n(sclk->refs + idx, &ref, 1, 0,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+unsigned sclk_rm(struct sclk *sclk, unsigned skip)
+{
+    unsigned char ref;
+    unsigned idx;
+
+    for (;;) {
+        idx = sclk->hand;
+        if (++sclk->hand == sclk->capacity)
+            sclk->hand = 0;
+
+        if (idx == skip)
+            continue;
+
+        ref = __atomic_load_n(sclk->refs + idx, __ATOMIC_RELAXED);
+        if (!ref) {
+            __atomic_store_n(sclk->refs + idx, SCLK_ABSENT, __ATOMIC_RELAXED);
+            return idx;
+        }
+
+        if (ref != SCLK_ABSENT)
+            __atomic_store_n(sclk->refs + idx, 0, __ATOMIC_RELAXED);
+    }
+}
+
+void sclk_rm_item(struct sclk *sclk, unsigned idx)
+{
+    __atomic_store_n(sclk->refs + idx, SCLK_ABSENT, __ATOMIC_RELAXED);
+}
+
+/*
+ * The hand reuses the frames with the bit cleared first, then the frames
+ * it has given a second chance, both in the order of the hand. Hits may
+ * set bits meanwhile, so every bit is read once: the frames with the bit
+ * set are put from the end and reversed.
+ */
+void sclk_order(struct sclk *sclk, unsigned *idxs, unsigned n)
+{
+    unsigned idx = sclk->hand;
+    unsigned head = 0;
+    unsigned tail = n;
+    unsigned char ref;
+    unsigned i;
+
+    for (i = 0; head < tail && i < sclk->capacity; ++i) {
+        ref = __atomic_load_n(sclk->refs + idx, __ATOMIC_RELAXED);
+        if (!ref)
+            idxs[head++] = idx;
+        else if (ref != SCLK_ABSENT)
+            idxs[--tail] = idx;
+        if (++idx == sclk->capacity)
+            idx = 0;
+    }
+
+    ASSERT(head == tail);
+
+    for (i = 0; i < (n - tail) / 2; ++i) {
+        idx = idxs[tail + i];
+        idxs[tail + i] = idxs[n - 1 - i];
+        idxs[n - 1 - i] = idx;
+    }
+}
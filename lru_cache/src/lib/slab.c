@@ -0,0 +1,262 @@
+/**
+ * @file
+ * Slab allocator for LRU frames
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "lru_cache/log.h"
+#include "lru_cache/mem.h"
+#include "lru_cache/slab.h"
+
+/*
+ * Chunks are grouped into classes by size, the size of the next class is
+ * 1.25 times the previous one. A chunk is carved from a page of its class
+ * and kept on the free list of the page once released, so no memory is
+ * allocated per chunk.
+ *
+ * Pages are aligned to their size, so the page of a chunk is found by its
+ * address. A page with free chunks is on the list of its class. A page
+ * whose chunks are all released leaves its class for the empty pages any
+ * class takes first, so the pages follow the sizes cached over time
+ * instead of staying with the classes they are carved for.
+ *
+ * Chunks larger than the largest class are allocated one by one.
+ *
+ * Pages are carved from blocks of a page or of a huge page with huge
+ * pages, the rest of a block is the page of the next class to grow.
+ */
+#define SLAB_PAGE_SIZE (1U << 20)
+#define SLAB_CHUNK_MIN 8U
+#define SLAB_CHUNK_MAX (SLAB_PAGE_SIZE / 16U)
+#define SLAB_N_CLASSES 64U
+
+struct slab_chunk {
+    struct slab_chunk *next;
+};
+
+/* The header of a page, the chunks follow it. */
+struct slab_page {
+    /** The neighbours on the list of the class or of the empty pages. */
+    struct slab_page *next;
+    struct slab_page *prev;
+    struct slab_chunk *free;
+    /** The next block, kept by the first page of a block. */
+    struct slab_page *next_block;
+    /** The offset of the chunks never allocated. */
+    unsigned top;
+    unsigned n_used;
+    unsigned cls;
+};
+
+#define SLAB_PAGE_HDR_SIZE \
+    ((sizeof(struct slab_page) + SLAB_CHUNK_MIN - 1) & ~(SLAB_CHUNK_MIN - 1))
+
+struct slab {
+    /** The pages with free chunks of every class. */
+    struct slab_page *pages[SLAB_N_CLASSES];
+    struct slab_page *empty;
+    struct slab_page *blocks;
+    /** The rest of the last block. */
+    char *spare;
+    char *spare_end;
+    unsigned block_size;
+    struct mem_attr mem;
+};
+
+static unsigned slab_sizes[SLAB_N_CLASSES];
+static unsigned slab_n_classes;
+
+static void slab_init_sizes(void)
+{
+    unsigned size = SLAB_CHUNK_MIN;
+    unsigned n = 0;
+
+    while (size < SLAB_CHUNK_MAX) {
+        slab_sizes[n++] = size;
+        size = (size + size / 4 + 7U) & ~7U;
+    }
+    slab_sizes[n++] = SLAB_CHUNK_MAX;
+
+    ASSERT(n <= SLAB_N_CLASSES);
+    slab_n_classes = n;
+}
+
+/* Find the class of the chunk for a number of bytes. */
+static unsigned slab_class(unsigned size)
+{
+    unsigned lo = 0;
+    unsigned hi = slab_n_classes - 1;
+    unsigned mid;
+
+    ASSERT(size <= SLAB_CHUNK_MAX);
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (slab_sizes[mid] < size)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+struct slab *slab_alloc(struct mem_attr const *mem)
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    struct slab *slab = calloc(1, sizeof(*slab));
+
+    die_on(!slab, "failed to allocate slab\n");
+
+    if (mem)
+        slab->mem = *mem;
+
+    BUILD_ASSERT(MEM_HUGE_PAGE_SIZE % SLAB_PAGE_SIZE == 0);
+    BUILD_ASSERT(SLAB_PAGE_HDR_SIZE + SLAB_CHUNK_MAX <= SLAB_PAGE_SIZE);
+    slab->block_size = slab->mem.pages == MEM_PAGES_DEFAULT ?
+                       SLAB_PAGE_SIZE : MEM_HUGE_PAGE_SIZE;
+
+    pthread_once(&once, slab_init_sizes);
+
+    return slab;
+}
+
+void slab_free(struct slab *slab)
+{
+    struct slab_page *block;
+
+    while (slab->blocks) {
+        block = slab->blocks;
+        slab->blocks = block->next_block;
+        mem_free(block, slab->block_size, &slab->mem);
+    }
+
+    free(slab);
+}
+
+unsigned slab_chunk_size(unsigned size)
+{
+    if (size > SLAB_CHUNK_MAX)
+        return size;
+
+    return slab_sizes[slab_class(size)];
+}
+
+static void slab_page_link(struct slab_page **list, struct slab_page *page)
+{
+    page->prev = NULL;
+    page->next = *list;
+    if (*list)
+        (*list)->prev = page;
+    *list = page;
+}
+
+static void slab_page_unlink(struct slab_page **list, struct slab_page *page)
+{
+    if (page->prev)
+        page->prev->next = page->next;
+    else
+        *list = page->next;
+    if (page->next)
+        page->next->prev = page->prev;
+}
+
+static int slab_page_full(struct slab_page *page)
+{
+    return !page->free && page->top + slab_sizes[page->cls] > SLAB_PAGE_SIZE;
+}
+
+/* Take an empty page or carve a new one for a class. */
+static struct slab_page *slab_grow(struct slab *slab, unsigned cls)
+{
+    struct slab_page *page = slab->empty;
+
+    if (page) {
+        slab_page_unlink(&slab->empty, page);
+    } else {
+        if (slab->spare == slab->spare_end) {
+            page = mem_alloc_aligned(slab->block_size, SLAB_PAGE_SIZE,
+                                     &slab->mem);
+            page->next_block = slab->blocks;
+            slab->blocks = page;
+            slab->spare = (char *) page;
+            slab->spare_end = (char *) page + slab->block_size;
+        }
+
+        page = (struct slab_page *) slab->spare;
+        slab->spare += SLAB_PAGE_SIZE;
+    }
+
+    /* Chunks are carved on demand, so pages are touched as they fill. */
+    page->free = NULL;
+    page->top = SLAB_PAGE_HDR_SIZE;
+    page->n_used = 0;
+    page->cls = cls;
+    slab_page_link(slab->pages + cls, page);
+
+    return page;
+}
+
+void *slab_get(struct slab *slab, unsigned size)
+{
+    struct slab_chunk *chunk;
+    struct slab_page *page;
+    unsigned cls;
+
+    if (size > SLAB_CHUNK_MAX) {
+        chunk = malloc(size);
+        die_on(!chunk, "failed to allocate large chunk: %u\n", size);
+        return chunk;
+    }
+
+    cls = slab_class(size);
+    page = slab->pages[cls];
+    if (!page)
+        page = slab_grow(slab, cls);
+
+    if (page->free) {
+        chunk = page->free;
+        page->free = chunk->next;
+    } else {
+        chunk = (struct slab_chunk *) ((char *) page + page->top);
+        page->top += slab_sizes[cls];
+    }
+
+    ++page->n_used;
+    if (slab_page_full(page))
+        slab_page_unlink(slab->pages + cls, page);
+
+    return chunk;
+}
+
+void slab_put(struct slab *slab, void *chunk, unsigned size)
+{
+    struct slab_chunk *c = chunk;
+    struct slab_page *page;
+    int full;
+
+    if (size > SLAB_CHUNK_MAX) {
+        free(chunk);
+        return;
+    }
+
+    page = (struct slab_page *) ((uintptr_t) chunk &
+                                 ~(uintptr_t) (SLAB_PAGE_SIZE - 1));
+    ASSERT(page->n_used && page->cls == slab_class(size));
+
+    full = slab_page_full(page);
+    c->next = page->free;
+    page->free = c;
+
+    if (!--page->n_used) {
+        if (!full)
+            slab_page_unlink(slab->pages + page->cls, page);
+        slab_page_link(&slab->empty, page);
+    } else if (full) {
+        slab_page_link(slab->pages + page->cls, page);
+    }
+}
@@ -0,0 +1,122 @@
+/**
+ * @file
+ * Segmented LRU for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <stdlib.h>
+#include "lru_cache/log.h"
+#include "lru_cache/mem.h"
+#include "lru_cache/lrul.h"
+#include "lru_cache/slru.h"
+
+/*
+ * New frames enter the probation list and move to the protected list once
+ * they are hit, i.e. accessed the second time. The protected list keeps up
+ * to SLRU_PROTECTED_PCT percent of the frames, the frames it drops go back
+ * to probation as its most recently used ones. Frames are reused from
+ * probation first, so a scan of keys accessed once cycles through
+ * probation and leaves the protected keys cached.
+ */
+#define SLRU_PROTECTED_PCT 80U
+
+enum slru_seg {
+    SLRU_PROBATION = 0,
+    SLRU_PROTECTED,
+    SLRU_N_SEGS,
+};
+
+struct slru {
+    struct lrul *lists;
+    /** The segments of the frames. */
+    unsigned char *segs;
+    unsigned n[SLRU_N_SEGS];
+    unsigned max_protected;
+    unsigned capacity;
+    struct mem_attr mem;
+};
+
+struct slru *slru_alloc(unsigned capacity, struct mem_attr const *mem)
+{
+    struct slru *slru = calloc(1, sizeof(*slru));
+
+    die_on(!slru, "failed to allocate SLRU\n");
+
+    if (mem)
+        slru->mem = *mem;
+
+    slru->lists = lrul_alloc(capacity, SLRU_N_SEGS, &slru->mem);
+    slru->segs = mem_alloc(capacity * sizeof(*slru->segs), &slru->mem);
+    slru->capacity = capacity;
+    slru->max_protected = (unsigned long long) capacity *
+                          SLRU_PROTECTED_PCT / 100U;
+
+    return slru;
+}
+
+void slru_free(struct slru *slru)
+{
+    mem_free(slru->segs, slru->capacity * sizeof(*slru->segs), &slru->mem);
+    lrul_free(slru->lists);
+    free(slru);
+}
+
+static void slru_push(struct slru *slru, unsigned seg, unsigned idx)
+{
+    lrul_add(slru->lists, seg, idx);
+    slru->segs[idx] = seg;
+    ++slru->n[seg];
+}
+
+static unsigned slru_pop(struct slru *slru, unsigned seg)
+{
+    --slru->n[seg];
+
+    return lrul_rm(slru->lists, seg);
+}
+
+void slru_add(struct slru *slru, unsigned idx)
+{
+    slru_push(slru, SLRU_PROBATION, idx);
+}
+
+void slru_hit(struct slru *slru, unsigned idx)
+{
+    slru_rm_item(slru, idx);
+    slru_push(slru, SLRU_PROTECTED, idx);
+
+    if (slru->n[SLRU_PROTECTED] > slru->max_protected)
+        slru_push(slru, SLRU_PROBATION,
+                  slru_pop(slru, SLRU_PROTECTED));
+}
+
+unsigned slru_rm(struct slru *slru, unsigned skip)
+{
+    unsigned idx = lrul_tail_skip(slru->lists, SLRU_PROBATION, skip);
+
+    if (idx == LRUL_NONE)
+        idx = lrul_tail_skip(slru->lists, SLRU_PROTECTED, skip);
+
+    ASSERT(idx != LRUL_NONE);
+
+    slru_rm_item(slru, idx);
+
+    return idx;
+}
+
+void slru_rm_item(struct slru *slru, unsigned idx)
+{
+    lrul_rm_item(slru->lists, idx);
+    --slru->n[slru->segs[idx]];
+}
+
+void slru_order(struct slru *slru, unsigned *idxs, unsigned n)
+{
+    ASSERT(n == slru->n[SLRU_PROBATION] + slru->n[SLRU_PROTECTED]);
+    (void) n;
+
+    lrul_order(slru->lists, SLRU_PROBATION, idxs, slru->n[SLRU_PROBATION]);
+    lrul_order(slru->lists, SLRU_PROTECTED,
+               idxs + slru->n[SLRU_PROBATION], slru->n[SLRU_PROTECTED]);
+}
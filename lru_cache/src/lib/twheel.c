@@ -0,0 +1,268 @@
+/**
+ * @file
+ * Hierarchical timing wheel for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <stdlib.h>
+#include "lru_cache/log.h"
+#include "lru_cache/mem.h"
+#include "lru_cache/twheel.h"
+
+/*
+ * The wheel has TWHEEL_LEVELS levels of 64 slots. A slot of the level l
+ * spans 64^l ticks, so a frame expiring within 64^(l + 1) ticks is kept
+ * in the slot of the level l its tick falls into. Once the wheel reaches
+ * the first tick of a slot of an upper level, the frames of the slot are
+ * cascaded to the lower levels. The frames of the slot of the level 0
+ * for a tick expire on that tick.
+ *
+ * A frame expiring beyond the top level is kept in the last slot the top
+ * level reaches, and it is cascaded back there until its tick is within
+ * reach.
+ *
+ * Every level has a bitmap of slots with frames, so the wheel advances
+ * straight to the next tick a slot with frames starts at, on any level,
+ * without walking the empty slots or the spans between them.
+ *
+ * As the LRU list, the slots are circular lists linked by indexes: the
+ * item for the frame i is items[i], and items[capacity + s] is the head
+ * of the slot s.
+ */
+#define TWHEEL_LEVELS 4U
+#define TWHEEL_BITS 6U
+#define TWHEEL_SLOTS (1U << TWHEEL_BITS)
+#define TWHEEL_MASK (TWHEEL_SLOTS - 1U)
+#define TWHEEL_SPAN (1ULL << (TWHEEL_LEVELS * TWHEEL_BITS))
+
+/** The index of the item not in the wheel. */
+#define TWHEEL_NONE (~0U)
+
+struct twheel_item {
+    unsigned prev;
+    unsigned next;
+    /** The tick to expire at or 0. */
+    uint64_t expire;
+};
+
+struct twheel {
+    struct twheel_item *items;
+    unsigned capacity;
+    unsigned size;
+    /** The last tick the wheel is advanced to. */
+    uint64_t now;
+    uint64_t used[TWHEEL_LEVELS];
+    struct mem_attr mem;
+};
+
+static unsigned twheel_n_items(unsigned capacity)
+{
+    return capacity + TWHEEL_LEVELS * TWHEEL_SLOTS;
+}
+
+struct twheel *twheel_alloc(unsigned capacity, uint64_t now,
+                            struct mem_attr const *mem)
+{
+    struct twheel *tw = calloc(1, sizeof(*tw));
+    struct twheel_item *head;
+    unsigned i;
+
+    die_on(!tw, "failed to allocate timing wheel\n");
+
+    if (mem)
+        tw->mem = *mem;
+
+    tw->items = mem_alloc(twheel_n_items(capacity) * sizeof(*tw->items),
+                          &tw->mem);
+    tw->capacity = capacity;
+    tw->now = now;
+
+    for (i = 0; i < capacity; ++i) {
+        tw->items[i].prev = TWHEEL_NONE;
+        tw->items[i].expire = 0;
+    }
+
+    for (i = capacity; i < twheel_n_items(capacity); ++i) {
+        head = tw->items + i;
+        head->prev = i;
+        head->next = i;
+    }
+
+    return tw;
+}
+
+void twheel_free(struct twheel *tw)
+{
+    mem_free(tw->items, twheel_n_items(tw->capacity) * sizeof(*tw->items),
+             &tw->mem);
+    free(tw);
+}
+
+/* Link a frame into the slot for its tick. */
+static void twheel_link(struct twheel *tw, unsigned idx)
+{
+    struct twheel_item *item = tw->items + idx;
+    uint64_t expire = item->expire;
+    uint64_t delta = expire - tw->now;
+    unsigned level = 0;
+    unsigned slot;
+    unsigned h;
+
+    ASSERT(expire >= tw->now);
+
+    if (delta >= TWHEEL_SPAN)
+        expire = tw->now + TWHEEL_SPAN - 1;
+
+    while (delta >= 1ULL << ((level + 1) * TWHEEL_BITS) &&
+           level < TWHEEL_LEVELS - 1)
+        ++level;
+
+    slot = (expire >> (level * TWHEEL_BITS)) & TWHEEL_MASK;
+    h = tw->capacity + level * TWHEEL_SLOTS + slot;
+
+    item->prev = h;
+    item->next = tw->items[h].next;
+    tw->items[item->next].prev = idx;
+    tw->items[h].next = idx;
+    tw->used[level] |= 1ULL << slot;
+}
+
+static void twheel_unlink(struct twheel *tw, unsigned idx)
+{
+    struct twheel_item *item = tw->items + idx;
+    unsigned h;
+
+    tw->items[item->prev].next = item->next;
+    tw->items[item->next].prev = item->prev;
+
+    /* Clear the bit of the slot if the head is left alone. */
+    if (item->prev == item->next && item->prev >= tw->capacity) {
+        h = item->prev - tw->capacity;
+        tw->used[h / TWHEEL_SLOTS] &= ~(1ULL << (h % TWHEEL_SLOTS));
+    }
+
+    item->prev = TWHEEL_NONE;
+}
+
+/*
+ * Set the tick of a frame, the lockless lookups of a cache read it while
+ * the wheel changes under the lock.
+ */
+static void twheel_set_expire(struct twheel *tw, unsigned idx,
+                              uint64_t expire)
+{
+    __atomic_store_n(&tw->items[idx].expire, expire, __ATOMIC_RELAXED);
+}
+
+void twheel_add(struct twheel *tw, unsigned idx, uint64_t expire)
+{
+    ASSERT(idx < tw->capacity && tw->items[idx].prev == TWHEEL_NONE);
+
+    twheel_set_expire(tw, idx, expire > tw->now ? expire : tw->now + 1);
+    twheel_link(tw, idx);
+    ++tw->size;
+}
+
+void twheel_rm(struct twheel *tw, unsigned idx)
+{
+    if (tw->items[idx].prev == TWHEEL_NONE)
+        return;
+
+    twheel_unlink(tw, idx);
+    twheel_set_expire(tw, idx, 0);
+    --tw->size;
+}
+
+uint64_t twheel_expire(struct twheel *tw, unsigned idx)
+{
+    return __atomic_load_n(&tw->items[idx].expire, __ATOMIC_RELAXED);
+}
+
+unsigned twheel_size(struct twheel *tw)
+{
+    return tw->size;
+}
+
+/* Move the frames of a slot to the slots for their ticks. */
+static void twheel_cascade(struct twheel *tw, unsigned level, unsigned slot)
+{
+    unsigned h = tw->capacity + level * TWHEEL_SLOTS + slot;
+    unsigned idx;
+
+    while ((idx = tw->items[h].next) != h) {
+        twheel_unlink(tw, idx);
+        twheel_link(tw, idx);
+    }
+}
+
+/* Get the first tick after now a slot of a level with frames starts at. */
+static uint64_t twheel_next(struct twheel *tw, unsigned level)
+{
+    unsigned shift = level * TWHEEL_BITS;
+    uint64_t block = (tw->now >> shift) + 1;
+    uint64_t used = tw->used[level];
+    unsigned r = block & TWHEEL_MASK;
+
+    if (!used)
+        return ~0ULL;
+
+    /* Rotate the bitmap for the slot of the next block to be bit 0. */
+    if (r)
+        used = (used >> r) | (used << (TWHEEL_SLOTS - r));
+
+    return (block + __builtin_ctzll(used)) << shift;
+}
+
+void twheel_advance(struct twheel *tw, uint64_t now,
+                    twheel_expire_t expire, void *ctx)
+{
+    uint64_t tick;
+    uint64_t next;
+    unsigned level;
+    unsigned slot;
+    unsigned h;
+    unsigned idx;
+
+    while (tw->now < now) {
+        if (!tw->size) {
+            tw->now = now;
+            break;
+        }
+
+        tick = ~0ULL;
+        for (level = 0; level < TWHEEL_LEVELS; ++level) {
+            next = twheel_next(tw, level);
+            if (tick > next)
+                tick = next;
+        }
+
+        if (tick > now) {
+            tw->now = now;
+            break;
+        }
+
+        /*
+         * The upper levels reaching a slot are cascaded top down. The
+         * frames of the tick itself land in the slot of the level 0
+         * expired next.
+         */
+        tw->now = tick;
+        for (level = TWHEEL_LEVELS - 1; level > 0; --level) {
+            if (!(tick & ((1ULL << (level * TWHEEL_BITS)) - 1)))
+                twheel_cascade(tw, level,
+                               (tick >> (level * TWHEEL_BITS)) & TWHEEL_MASK);
+        }
+
+        slot = tick & TWHEEL_MASK;
+        h = tw->capacity + slot;
+
+        while ((idx = tw->items[h].next) != h) {
+            ASSERT(tw->items[idx].expire <= tick);
+            twheel_unlink(tw, idx);
+            twheel_set_expire(tw, idx, 0);
+            --tw->size;
+            expire(ctx, idx);
+        }
+    }
+}
@@ -0,0 +1,199 @@
+/**
+ * @file
+ * W-TinyLFU for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <stdlib.h>
+#include "lru_cache/log.h"
+#include "lru_cache/mem.h"
+#include "lru_cache/lrul.h"
+#include "lru_cache/fsketch.h"
+#include "lru_cache/wtlfu.h"
+
+/*
+ * Einziger et al., TinyLFU: A Highly Efficient Cache Admission Policy.
+ *
+ * New keys enter a window LRU of 1% of the frames. A key leaving the
+ * window is a candidate for the main segment, the rest of the frames. The
+ * candidate replaces the victim of the main segment only if the sketch
+ * estimates it to be accessed more often. So, keys accessed once pass
+ * through the window without evicting the keys of the main segment.
+ *
+ * The main segment is an SLRU: keys enter its probation list and move to
+ * the protected list on a hit. The protected list keeps up to 80% of the
+ * main segment, the keys it drops go back to probation. The victim is the
+ * last recently used key of probation.
+ */
+enum wtlfu_seg {
+    WTLFU_WINDOW = 0,
+    WTLFU_PROBATION,
+    WTLFU_PROTECTED,
+    WTLFU_N_SEGS,
+};
+
+struct wtlfu {
+    struct lrul *lists;
+    struct fsketch *sketch;
+    /** The key hashes of the frames. */
+    unsigned *hashes;
+    /** The segments of the frames. */
+    unsigned char *segs;
+    unsigned n[WTLFU_N_SEGS];
+    unsigned max_window;
+    unsigned max_protected;
+    unsigned capacity;
+    struct mem_attr mem;
+};
+
+struct wtlfu *wtlfu_alloc(unsigned capacity, struct mem_attr const *mem)
+{
+    struct wtlfu *wtlfu = calloc(1, sizeof(*wtlfu));
+
+    die_on(!wtlfu, "failed to allocate W-TinyLFU\n");
+
+    if (mem)
+        wtlfu->mem = *mem;
+
+    wtlfu->lists = lrul_alloc(capacity, WTLFU_N_SEGS, &wtlfu->mem);
+    wtlfu->sketch = fsketch_alloc(capacity, &wtlfu->mem);
+    wtlfu->hashes = mem_alloc(capacity * sizeof(*wtlfu->hashes),
+                              &wtlfu->mem);
+    wtlfu->segs = mem_alloc(capacity * sizeof(*wtlfu->segs), &wtlfu->mem);
+    wtlfu->capacity = capacity;
+    wtlfu->max_window = capacity / 100U ? capacity / 100U : 1U;
+    wtlfu->max_protected = (capacity - wtlfu->max_window) / 5U * 4U;
+
+    return wtlfu;
+}
+
+void wtlfu_free(struct wtlfu *wtlfu)
+{
+    mem_free(wtlfu->segs, wtlfu->capacity * sizeof(*wtlfu->segs),
+             &wtlfu->mem);
+    mem_free(wtlfu->hashes, wtlfu->capacity * sizeof(*wtlfu->hashes),
+             &wtlfu->mem);
+    fsketch_free(wtlfu->sketch);
+    lrul_free(wtlfu->lists);
+    free(wtlfu);
+}
+
+static void wtlfu_push(struct wtlfu *wtlfu, unsigned seg, unsigned idx)
+{
+    lrul_add(wtlfu->lists, seg, idx);
+    wtlfu->segs[idx] = seg;
+    ++wtlfu->n[seg];
+}
+
+static unsigned wtlfu_pop(struct wtlfu *wtlfu, unsigned seg)
+{
+    --wtlfu->n[seg];
+
+    return lrul_rm(wtlfu->lists, seg);
+}
+
+void wtlfu_add(struct wtlfu *wtlfu, unsigned idx, unsigned hash)
+{
+    wtlfu->hashes[idx] = hash;
+    fsketch_add(wtlfu->sketch, hash);
+    wtlfu_push(wtlfu, WTLFU_WINDOW, idx);
+
+    /* There are free frames, so the candidate needs no victim. */
+    if (wtlfu->n[WTLFU_WINDOW] > wtlfu->max_window)
+        wtlfu_push(wtlfu, WTLFU_PROBATION,
+                   wtlfu_pop(wtlfu, WTLFU_WINDOW));
+}
+
+void wtlfu_hit(struct wtlfu *wtlfu, unsigned idx)
+{
+    unsigned seg = wtlfu->segs[idx];
+
+    fsketch_add(wtlfu->sketch, wtlfu->hashes[idx]);
+
+    lrul_rm_item(wtlfu->lists, idx);
+    --wtlfu->n[seg];
+
+    if (seg == WTLFU_WINDOW) {
+        wtlfu_push(wtlfu, WTLFU_WINDOW, idx);
+        return;
+    }
+
+    wtlfu_push(wtlfu, WTLFU_PROTECTED, idx);
+    if (wtlfu->n[WTLFU_PROTECTED] > wtlfu->max_protected)
+        wtlfu_push(wtlfu, WTLFU_PROBATION,
+                   wtlfu_pop(wtlfu, WTLFU_PROTECTED));
+}
+
+/* Extract the last recently used frame of a segment other than skip. */
+static unsigned wtlfu_pop_skip(struct wtlfu *wtlfu, unsigned seg,
+                               unsigned skip)
+{
+    unsigned idx = lrul_tail_skip(wtlfu->lists, seg, skip);
+
+    ASSERT(idx != LRUL_NONE);
+
+    wtlfu_rm_item(wtlfu, idx);
+
+    return idx;
+}
+
+unsigned wtlfu_rm(struct wtlfu *wtlfu, unsigned skip)
+{
+    unsigned cand;
+    unsigned victim;
+
+    victim = lrul_tail_skip(wtlfu->lists, WTLFU_PROBATION, skip);
+    if (victim == LRUL_NONE)
+        victim = lrul_tail_skip(wtlfu->lists, WTLFU_PROTECTED, skip);
+    if (victim == LRUL_NONE)
+        return wtlfu_pop_skip(wtlfu, WTLFU_WINDOW, skip);
+
+    cand = lrul_tail_skip(wtlfu->lists, WTLFU_WINDOW, skip);
+
+    /*
+     * The window has room for the key added next, so it keeps its keys, as
+     * it does with no candidate but skip.
+     */
+    if (wtlfu->n[WTLFU_WINDOW] < wtlfu->max_window || cand == LRUL_NONE) {
+        wtlfu_rm_item(wtlfu, victim);
+        return victim;
+    }
+
+    if (fsketch_estimate(wtlfu->sketch, wtlfu->hashes[cand]) <=
+        fsketch_estimate(wtlfu->sketch, wtlfu->hashes[victim])) {
+        wtlfu_rm_item(wtlfu, cand);
+        return cand;
+    }
+
+    wtlfu_rm_item(wtlfu, cand);
+    wtlfu_push(wtlfu, WTLFU_PROBATION, cand);
+    wtlfu_rm_item(wtlfu, victim);
+
+    return victim;
+}
+
+void wtlfu_rm_item(struct wtlfu *wtlfu, unsigned idx)
+{
+    lrul_rm_item(wtlfu->lists, idx);
+    --wtlfu->n[wtlfu->segs[idx]];
+}
+
+void wtlfu_order(struct wtlfu *wtlfu, unsigned *idxs, unsigned n)
+{
+    static unsigned char const segs[] = {
+        WTLFU_PROBATION,
+        WTLFU_PROTECTED,
+        WTLFU_WINDOW,
+    };
+    unsigned i;
+
+    ASSERT(n == wtlfu->n[WTLFU_WINDOW] + wtlfu->n[WTLFU_PROBATION] +
+                wtlfu->n[WTLFU_PROTECTED]);
+    (void) n;
+
+    for (i = 0; i < sizeof(segs); ++i) {
+        lrul_order(wtlfu->lists, segs[i], idxs, wtlfu->n[segs[i]]);
+        idxs += wtlfu->n[segs[i]];
+    }
+}
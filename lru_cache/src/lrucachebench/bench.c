@@ -0,0 +1,225 @@
+/**
+ * @file
+ *
+ * LRU cache benchmark runner
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "lru_cache/log.h"
+#include "lru_cache/lru_cache_define.h"
+#include "bench.h"
+
+static inline unsigned bench_gen_hash(int const *key)
+{
+    return lru_cache_hash_u64((unsigned) *key);
+}
+
+static inline int bench_gen_eq(int const *a, int const *b)
+{
+    return *a == *b;
+}
+
+LRU_CACHE_DEFINE(bench_gen, int, int, bench_gen_hash, bench_gen_eq)
+
+struct bench_thread {
+    pthread_t thread;
+    struct bench_attr const *attr;
+    struct lru_cache *cache;
+    struct bench_gen *gen;
+    /** Nonzero for the thread resizing the cache. */
+    int resizer;
+    pthread_barrier_t *start;
+    struct wl *wl;
+    unsigned *samples;
+    unsigned long gets;
+    unsigned long hits;
+    unsigned long long t_start;
+    unsigned long long t_end;
+};
+
+static unsigned long long bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Run an operation, @retval 1 for a hit or 0 otherwise. */
+static int bench_op(struct lru_cache *cache, struct wl_op const *op)
+{
+    if (!op->get) {
+        lru_cache_put(cache, op->key, op->key);
+        return 0;
+    }
+
+    if (lru_cache_get(cache, op->key) != -1)
+        return 1;
+
+    lru_cache_put(cache, op->key, op->key);
+
+    return 0;
+}
+
+/* Run an operation against the generated cache as bench_op() does. */
+static int bench_gen_op(struct bench_gen *gen, struct wl_op const *op)
+{
+    if (op->get && bench_gen_get(gen, &op->key))
+        return 1;
+
+    bench_gen_put(gen, &op->key, &op->key);
+
+    return 0;
+}
+
+static int bench_thread_op(struct bench_thread *t, struct wl_op const *op)
+{
+    return t->gen ? bench_gen_op(t->gen, op) : bench_op(t->cache, op);
+}
+
+static void *bench_thread_run(void *arg)
+{
+    struct bench_thread *t = arg;
+    unsigned long resize_at = ~0UL;
+    unsigned long long t0;
+    unsigned long long dt;
+    struct wl_op op;
+    unsigned long i;
+    int hit;
+
+    for (i = 0; i < t->attr->n_warmup; ++i) {
+        wl_next(t->wl, &op);
+        bench_thread_op(t, &op);
+    }
+
+    if (t->resizer)
+        resize_at = t->attr->n_ops / 2;
+
+    pthread_barrier_wait(t->start);
+    t->t_start = bench_now();
+
+    for (i = 0; i < t->attr->n_ops; ++i) {
+        wl_next(t->wl, &op);
+
+        t0 = bench_now();
+        if (i == resize_at)
+            lru_cache_resize(t->cache, t->attr->resize);
+        hit = bench_thread_op(t, &op);
+        dt = bench_now() - t0;
+
+        t->samples[i] = dt < ~0U ? dt : ~0U;
+        t->gets += op.get;
+        t->hits += hit;
+    }
+
+    t->t_end = bench_now();
+
+    return NULL;
+}
+
+static int bench_cmp(void const *a, void const *b)
+{
+    unsigned x = *(unsigned const *) a;
+    unsigned y = *(unsigned const *) b;
+
+    return (x > y) - (x < y);
+}
+
+static unsigned long long bench_percentile(unsigned const *samples,
+                                           unsigned long n, double p)
+{
+    unsigned long i = n * p;
+
+    return samples[i < n ? i : n - 1];
+}
+
+void bench_run(struct bench_attr const *attr, struct bench_result *result)
+{
+    unsigned long n = attr->n_ops * attr->n_threads;
+    struct bench_thread *threads;
+    pthread_barrier_t start;
+    unsigned long long t_start = ~0ULL;
+    unsigned long long t_end = 0;
+    unsigned long long dt;
+    struct lru_cache *cache = NULL;
+    struct bench_gen *gen = NULL;
+    unsigned *samples;
+    unsigned long gets = 0;
+    unsigned long hits = 0;
+    unsigned i;
+    int rc;
+
+    die_on(!attr->n_threads || !attr->n_ops, "nothing to benchmark\n");
+    die_on(attr->n_threads > 1 && !attr->cache.n_shards,
+           "many threads need a thread safe cache\n");
+    die_on(attr->generated && attr->n_threads > 1,
+           "a generated cache is not thread safe\n");
+    die_on(attr->generated && attr->resize,
+           "a generated cache is not resized\n");
+
+    if (attr->generated) {
+        gen = bench_gen_alloc(attr->capacity);
+        die_on(!gen, "failed to allocate generated cache: capacity %u\n",
+               attr->capacity);
+    } else {
+        cache = lru_cache_alloc_attr(attr->capacity, &attr->cache);
+    }
+
+    threads = calloc(attr->n_threads, sizeof(*threads));
+    samples = malloc(n * sizeof(*samples));
+    die_on(!threads || !samples, "failed to allocate benchmark state\n");
+
+    rc = pthread_barrier_init(&start, NULL, attr->n_threads + 1);
+    die_on(rc, "failed to initialize barrier: %d\n", rc);
+
+    for (i = 0; i < attr->n_threads; ++i) {
+        threads[i].attr = attr;
+        threads[i].cache = cache;
+        threads[i].gen = gen;
+        threads[i].resizer = attr->resize && !i;
+        threads[i].start = &start;
+        threads[i].wl = wl_alloc(&attr->wl, i);
+        threads[i].samples = samples + i * attr->n_ops;
+
+        rc = pthread_create(&threads[i].thread, NULL, bench_thread_run,
+                            threads + i);
+        die_on(rc, "failed to create thread: %d\n", rc);
+    }
+
+    pthread_barrier_wait(&start);
+
+    for (i = 0; i < attr->n_threads; ++i) {
+        pthread_join(threads[i].thread, NULL);
+        gets += threads[i].gets;
+        hits += threads[i].hits;
+        if (t_start > threads[i].t_start)
+            t_start = threads[i].t_start;
+        if (t_end < threads[i].t_end)
+            t_end = threads[i].t_end;
+        wl_free(threads[i].wl);
+    }
+
+    dt = t_end - t_start;
+
+    qsort(samples, n, sizeof(*samples), bench_cmp);
+
+    result->ops_per_sec = n * 1e9 / (dt ? dt : 1);
+    result->hit_ratio = gets ? (double) hits / gets : 0;
+    result->p50 = bench_percentile(samples, n, 0.5);
+    result->p99 = bench_percentile(samples, n, 0.99);
+    result->p999 = bench_percentile(samples, n, 0.999);
+    result->max = samples[n - 1];
+
+    pthread_barrier_destroy(&start);
+    free(samples);
+    free(threads);
+    if (gen)
+        bench_gen_free(gen);
+    else
+        lru_cache_free(cache);
+}
@@ -0,0 +1,59 @@
+/**
+ * @file
+ *
+ * LRU cache benchmark runner
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "lru_cache/lru_cache.h"
+#include "wl.h"
+
+struct bench_attr {
+    struct wl_attr wl;
+    struct lru_cache_attr cache;
+    unsigned capacity;
+    /** The number of operations measured per thread. */
+    unsigned long n_ops;
+    /** The number of operations per thread to run before measuring. */
+    unsigned long n_warmup;
+    /** The number of threads, a thread safe cache is needed for many. */
+    unsigned n_threads;
+    /**
+     * Run against an LRU cache of int keys and values generated by
+     * LRU_CACHE_DEFINE() instead of the library, in one thread.
+     */
+    int generated;
+    /**
+     * Resize the cache to this capacity halfway through the operations
+     * measured by the first thread, 0 for none. The resize is measured
+     * as a part of that operation.
+     */
+    unsigned resize;
+};
+
+struct bench_result {
+    double ops_per_sec;
+    /** The share of gets that hit. */
+    double hit_ratio;
+    /** Per operation latency percentiles in nanoseconds. */
+    unsigned long long p50;
+    unsigned long long p99;
+    unsigned long long p999;
+    /** The worst latency, e.g. of a put rehashing the table. */
+    unsigned long long max;
+};
+
+/**
+ * Run a workload against a new cache.
+ *
+ * A get that misses puts the key into the cache, as a caller filling the
+ * cache from the backend would do. Both are measured as one operation.
+ */
+extern void bench_run(struct bench_attr const *attr,
+                      struct bench_result *result);
+
+#endif /* BENCH_H */
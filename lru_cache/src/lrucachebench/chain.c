@@ -0,0 +1,74 @@
+/**
+ * @file
+ *
+ * Hash chain length benchmark for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <string.h>
+#include "chain.h"
+
+static char const *const chain_kind_names[] = {
+    [CHAIN_SEQ] = "seq",
+    [CHAIN_STRIDE] = "stride",
+    [CHAIN_RANDOM] = "random",
+};
+
+int chain_kind_parse(char const *name, enum chain_kind *kind)
+{
+    unsigned i;
+
+    for (i = 0; i < sizeof(chain_kind_names) / sizeof(chain_kind_names[0]);
+         ++i) {
+        if (!strcmp(name, chain_kind_names[i])) {
+            *kind = i;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+char const *chain_kind_name(enum chain_kind kind)
+{
+    return chain_kind_names[kind];
+}
+
+/* xorshift64* */
+static unsigned long long chain_rand(unsigned long long *rnd)
+{
+    *rnd ^= *rnd >> 12;
+    *rnd ^= *rnd << 25;
+    *rnd ^= *rnd >> 27;
+
+    return *rnd * 0x2545f4914f6cdd1dULL;
+}
+
+void chain_run(struct chain_attr const *attr, struct lru_cache_stats *stats)
+{
+    struct lru_cache *cache = lru_cache_alloc_attr(attr->capacity,
+                                                   &attr->cache);
+    unsigned long long rnd = 0x9e3779b97f4a7c15ULL;
+    unsigned i;
+    int key;
+
+    for (i = 0; i < attr->capacity; ++i) {
+        switch (attr->kind) {
+        case CHAIN_SEQ:
+            key = i;
+            break;
+        case CHAIN_STRIDE:
+            key = i * attr->stride;
+            break;
+        default:
+            key = chain_rand(&rnd) >> 32;
+            break;
+        }
+
+        lru_cache_put(cache, key, i);
+    }
+
+    lru_cache_stats(cache, stats);
+    lru_cache_free(cache);
+}
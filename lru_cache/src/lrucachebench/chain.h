@@ -0,0 +1,49 @@
+/**
+ * @file
+ *
+ * Hash chain length benchmark for LRU cache
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#ifndef CHAIN_H
+#define CHAIN_H
+
+#include "lru_cache/lru_cache.h"
+
+/** The set of keys to fill a cache with. */
+enum chain_kind {
+    /** Keys 0, 1, 2, ... */
+    CHAIN_SEQ = 0,
+    /** Keys 0, stride, 2 * stride, ... */
+    CHAIN_STRIDE,
+    /** Random keys. */
+    CHAIN_RANDOM,
+};
+
+struct chain_attr {
+    enum chain_kind kind;
+    unsigned stride;
+    struct lru_cache_attr cache;
+    /** The capacity of the cache and the number of keys. */
+    unsigned capacity;
+};
+
+/**
+ * Fill a new cache with a key set and get the probe length histogram.
+ *
+ * The probe length of a key is the distance from its home slot to its
+ * slot, so it is the length of the chain to walk to find the key.
+ */
+extern void chain_run(struct chain_attr const *attr,
+                      struct lru_cache_stats *stats);
+
+/**
+ * Get the kind of a key set by name.
+ *
+ * @retval 0 if the name is known or -1 otherwise.
+ */
+extern int chain_kind_parse(char const *name, enum chain_kind *kind);
+extern char const *chain_kind_name(enum chain_kind kind);
+
+#endif /* CHAIN_H */
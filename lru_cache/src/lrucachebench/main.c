@@ -0,0 +1,443 @@
+/**
+ * @file
+ *
+ * LRU cache benchmark
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "lru_cache/log.h"
+#include "bench.h"
+#include "chain.h"
+
+#define MAX_SWEEP 32
+
+enum out_format {
+    OUT_CSV = 0,
+    OUT_JSON,
+};
+
+struct sweep {
+    enum wl_kind kinds[MAX_SWEEP];
+    unsigned n_kinds;
+    enum lru_cache_policy policies[MAX_SWEEP];
+    unsigned n_policies;
+    enum chain_kind chains[MAX_SWEEP];
+    unsigned n_chains;
+    unsigned capacities[MAX_SWEEP];
+    unsigned n_capacities;
+    unsigned keys[MAX_SWEEP];
+    unsigned n_keys;
+};
+
+static char const *const policy_names[] = {
+    [LRU_CACHE_POLICY_LRU] = "lru",
+    [LRU_CACHE_POLICY_CLOCK] = "clock",
+    [LRU_CACHE_POLICY_TINYLFU] = "tinylfu",
+    [LRU_CACHE_POLICY_SLRU] = "slru",
+    [LRU_CACHE_POLICY_ARC] = "arc",
+};
+
+static char const *const pages_names[] = {
+    [LRU_CACHE_PAGES_DEFAULT] = "default",
+    [LRU_CACHE_PAGES_HUGE] = "huge",
+    [LRU_CACHE_PAGES_HUGETLB] = "hugetlb",
+};
+
+static void usage(FILE *fp, char const *name)
+{
+    fprintf(fp,
+            "Usage: %s [OPTION]...\n"
+            "Benchmark LRU cache with generated workloads.\n"
+            "\n"
+            "Every combination of workloads, policies, capacities and key\n"
+            "spaces is run against a new cache and reported as a row.\n"
+            "\n"
+            "With -H, every key set fills a new cache of every capacity\n"
+            "instead, and the histogram of the hash probe lengths is\n"
+            "reported.\n"
+            "\n"
+            "  -w LIST    workloads: uniform, zipf, scan, crawl\n"
+            "             (uniform,zipf,scan)\n"
+            "  -s SKEW    Zipfian skew within (0, 1) (0.99)\n"
+            "  -r RATIO   the share of gets, the rest are puts (0.9)\n"
+            "  -c LIST    cache capacities (1000,100000)\n"
+            "  -k LIST    key space sizes (10000,1000000)\n"
+            "  -n OPS     operations measured per thread (1000000)\n"
+            "  -W OPS     operations run per thread before measuring\n"
+            "             (the capacity)\n"
+            "  -p LIST    policies: lru, clock, tinylfu, slru, arc (lru)\n"
+            "  -S SHARDS  shards of a thread safe cache, 0 for unsafe (0)\n"
+            "  -L         look up keys of a thread safe cache without locks\n"
+            "  -B         buffer the hits of a thread safe cache\n"
+            "  -G         run the lru rows of a cache that is not thread\n"
+            "             safe against a cache of int keys generated by\n"
+            "             LRU_CACHE_DEFINE() too\n"
+            "  -R CAPACITY resize the cache to a capacity halfway through\n"
+            "             the measured operations of the first thread\n"
+            "  -m PAGES   cache memory pages: default, huge, hugetlb\n"
+            "             (default)\n"
+            "  -N NUMA    bind the cache memory to a NUMA node or interleave\n"
+            "             it across the nodes with 'interleave'\n"
+            "  -t THREADS threads, they need a thread safe cache (1)\n"
+            "  -H LIST    key sets: seq, stride, random\n"
+            "  -x STRIDE  the key stride of the stride key set (4096)\n"
+            "  -f FORMAT  csv or json (csv)\n"
+            "  -h         print this help\n",
+            name);
+}
+
+static unsigned long parse_num(char const *s)
+{
+    char *end;
+    unsigned long n = strtoul(s, &end, 0);
+
+    die_on(end == s || *end, "invalid number '%s'\n", s);
+
+    return n;
+}
+
+static unsigned parse_nums(char *s, unsigned *nums)
+{
+    unsigned n = 0;
+    char *tok;
+
+    for (tok = strtok(s, ","); tok; tok = strtok(NULL, ",")) {
+        die_on(n == MAX_SWEEP, "too many values to sweep\n");
+        nums[n++] = parse_num(tok);
+    }
+
+    return n;
+}
+
+static unsigned parse_kinds(char *s, enum wl_kind *kinds)
+{
+    unsigned n = 0;
+    char *tok;
+
+    for (tok = strtok(s, ","); tok; tok = strtok(NULL, ",")) {
+        die_on(n == MAX_SWEEP, "too many workloads to sweep\n");
+        die_on(wl_kind_parse(tok, kinds + n), "unknown workload '%s'\n", tok);
+        ++n;
+    }
+
+    return n;
+}
+
+static unsigned parse_chains(char *s, enum chain_kind *kinds)
+{
+    unsigned n = 0;
+    char *tok;
+
+    for (tok = strtok(s, ","); tok; tok = strtok(NULL, ",")) {
+        die_on(n == MAX_SWEEP, "too many key sets to sweep\n");
+        die_on(chain_kind_parse(tok, kinds + n), "unknown key set '%s'\n",
+               tok);
+        ++n;
+    }
+
+    return n;
+}
+
+static enum lru_cache_policy parse_policy(char const *s)
+{
+    unsigned i;
+
+    for (i = 0; i < sizeof(policy_names) / sizeof(policy_names[0]); ++i) {
+        if (!strcmp(s, policy_names[i]))
+            return i;
+    }
+
+    die("unknown policy '%s'\n", s);
+}
+
+static unsigned parse_policies(char *s, enum lru_cache_policy *policies)
+{
+    unsigned n = 0;
+    char *tok;
+
+    for (tok = strtok(s, ","); tok; tok = strtok(NULL, ",")) {
+        die_on(n == MAX_SWEEP, "too many policies to sweep\n");
+        policies[n++] = parse_policy(tok);
+    }
+
+    return n;
+}
+
+static enum lru_cache_pages parse_pages(char const *s)
+{
+    unsigned i;
+
+    for (i = 0; i < sizeof(pages_names) / sizeof(pages_names[0]); ++i) {
+        if (!strcmp(s, pages_names[i]))
+            return i;
+    }
+
+    die("unknown pages '%s'\n", s);
+}
+
+static void parse_numa(char const *s, struct lru_cache_attr *attr)
+{
+    if (!strcmp(s, "interleave")) {
+        attr->numa = LRU_CACHE_NUMA_INTERLEAVE;
+    } else {
+        attr->numa = LRU_CACHE_NUMA_BIND;
+        attr->numa_node = parse_num(s);
+    }
+}
+
+static void print_header(FILE *fp, enum out_format format)
+{
+    if (format == OUT_CSV)
+        fprintf(fp, "workload,skew,read_ratio,policy,pages,shards,lockless,"
+                    "buffered,generated,threads,capacity,resize,keys,ops,"
+                    "ops_per_sec,hit_ratio,"
+                    "p50_ns,p99_ns,p999_ns,max_ns\n");
+    else
+        fprintf(fp, "[");
+}
+
+static void print_result(FILE *fp, enum out_format format, int first,
+                         struct bench_attr const *attr,
+                         struct bench_result const *res)
+{
+    char const *fmt;
+
+    if (format == OUT_CSV) {
+        fmt = "%s,%g,%g,%s,%s,%u,%d,%d,%d,%u,%u,%u,%u,%lu,%.0f,%.6f,%llu,"
+              "%llu,%llu,%llu\n";
+    } else {
+        fmt = "{\"workload\": \"%s\", \"skew\": %g, "
+              "\"read_ratio\": %g, \"policy\": \"%s\", \"pages\": \"%s\", "
+              "\"shards\": %u, \"lockless\": %d, \"buffered\": %d, "
+              "\"generated\": %d, \"threads\": %u, \"capacity\": %u, "
+              "\"resize\": %u, \"keys\": %u, "
+              "\"ops\": %lu, \"ops_per_sec\": %.0f, \"hit_ratio\": %.6f, "
+              "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, "
+              "\"max_ns\": %llu}";
+        fprintf(fp, "%s\n  ", first ? "" : ",");
+    }
+
+    fprintf(fp, fmt,
+            wl_kind_name(attr->wl.kind), attr->wl.skew,
+            attr->wl.read_ratio, policy_names[attr->cache.policy],
+            pages_names[attr->cache.pages], attr->cache.n_shards,
+            attr->cache.lockless, attr->cache.buffered_hits,
+            attr->generated, attr->n_threads, attr->capacity,
+            attr->resize, attr->wl.n_keys, attr->n_ops * attr->n_threads,
+            res->ops_per_sec, res->hit_ratio,
+            res->p50, res->p99, res->p999, res->max);
+    fflush(fp);
+}
+
+static void print_chain_header(FILE *fp, enum out_format format)
+{
+    if (format == OUT_CSV)
+        fprintf(fp, "keys,stride,shards,capacity,slots,used,probes\n");
+    else
+        fprintf(fp, "[");
+}
+
+/* The probe histogram is a list of LRU_CACHE_STATS_PROBES bins. */
+static void print_chain_result(FILE *fp, enum out_format format, int first,
+                               struct chain_attr const *attr,
+                               struct lru_cache_stats const *stats)
+{
+    char const *sep = format == OUT_CSV ? ";" : ", ";
+    unsigned i;
+
+    if (format == OUT_CSV)
+        fprintf(fp, "%s,%u,%u,%u,%u,%u,",
+                chain_kind_name(attr->kind), attr->stride,
+                attr->cache.n_shards, attr->capacity, stats->n_slots,
+                stats->n_used);
+    else
+        fprintf(fp, "%s\n  {\"keys\": \"%s\", \"stride\": %u, "
+                    "\"shards\": %u, \"capacity\": %u, \"slots\": %u, "
+                    "\"used\": %u, \"probes\": [",
+                first ? "" : ",", chain_kind_name(attr->kind), attr->stride,
+                attr->cache.n_shards, attr->capacity, stats->n_slots,
+                stats->n_used);
+
+    for (i = 0; i < LRU_CACHE_STATS_PROBES; ++i)
+        fprintf(fp, "%s%u", i ? sep : "", stats->probes[i]);
+
+    fputs(format == OUT_CSV ? "\n" : "]}", fp);
+    fflush(fp);
+}
+
+static void print_footer(FILE *fp, enum out_format format)
+{
+    if (format == OUT_JSON)
+        fprintf(fp, "\n]\n");
+}
+
+int main(int argc, char **argv)
+{
+    char workloads[] = "uniform,zipf,scan";
+    char capacities[] = "1000,100000";
+    char keys[] = "10000,1000000";
+    struct bench_attr attr = {
+        .wl = {
+            .skew = 0.99,
+            .read_ratio = 0.9,
+        },
+        .cache = {
+            .policy = LRU_CACHE_POLICY_LRU,
+        },
+        .n_ops = 1000000,
+        .n_threads = 1,
+    };
+    enum out_format format = OUT_CSV;
+    long warmup = -1;
+    struct bench_result res;
+    struct chain_attr chain = {
+        .stride = 4096,
+    };
+    struct lru_cache_stats stats;
+    struct sweep sweep;
+    unsigned w, p, c, k;
+    int generated = 0;
+    int first = 1;
+    int opt;
+
+    sweep.n_kinds = parse_kinds(workloads, sweep.kinds);
+    sweep.policies[0] = LRU_CACHE_POLICY_LRU;
+    sweep.n_policies = 1;
+    sweep.n_capacities = parse_nums(capacities, sweep.capacities);
+    sweep.n_keys = parse_nums(keys, sweep.keys);
+    sweep.n_chains = 0;
+
+    while ((opt = getopt(argc, argv, "w:s:r:c:k:n:W:p:S:LBGR:m:N:t:H:x:f:h")) != -1) {
+        switch (opt) {
+        case 'w':
+            sweep.n_kinds = parse_kinds(optarg, sweep.kinds);
+            break;
+        case 's':
+            attr.wl.skew = atof(optarg);
+            break;
+        case 'r':
+            attr.wl.read_ratio = atof(optarg);
+            break;
+        case 'c':
+            sweep.n_capacities = parse_nums(optarg, sweep.capacities);
+            break;
+        case 'k':
+            sweep.n_keys = parse_nums(optarg, sweep.keys);
+            break;
+        case 'n':
+            attr.n_ops = parse_num(optarg);
+            break;
+        case 'W':
+            warmup = parse_num(optarg);
+            break;
+        case 'p':
+            sweep.n_policies = parse_policies(optarg, sweep.policies);
+            break;
+        case 'S':
+            attr.cache.n_shards = parse_num(optarg);
+            break;
+        case 'L':
+            attr.cache.lockless = 1;
+            break;
+        case 'B':
+            attr.cache.buffered_hits = 1;
+            break;
+        case 'G':
+            generated = 1;
+            break;
+        case 'R':
+            attr.resize = parse_num(optarg);
+            break;
+        case 'm':
+            attr.cache.pages = parse_pages(optarg);
+            break;
+        case 'N':
+            parse_numa(optarg, &attr.cache);
+            break;
+        case 't':
+            attr.n_threads = parse_num(optarg);
+            break;
+        case 'H':
+            sweep.n_chains = parse_chains(optarg, sweep.chains);
+            break;
+        case 'x':
+            chain.stride = parse_num(optarg);
+            break;
+        case 'f':
+            if (!strcmp(optarg, "csv"))
+                format = OUT_CSV;
+            else if (!strcmp(optarg, "json"))
+                format = OUT_JSON;
+            else
+                die("unknown format '%s'\n", optarg);
+            break;
+        case 'h':
+            usage(stdout, argv[0]);
+            return 0;
+        default:
+            usage(stderr, argv[0]);
+            return 1;
+        }
+    }
+
+    if (sweep.n_chains) {
+        chain.cache = attr.cache;
+        chain.cache.policy = sweep.policies[0];
+        print_chain_header(stdout, format);
+
+        for (w = 0; w < sweep.n_chains; ++w) {
+            for (c = 0; c < sweep.n_capacities; ++c) {
+                chain.kind = sweep.chains[w];
+                chain.capacity = sweep.capacities[c];
+
+                chain_run(&chain, &stats);
+                print_chain_result(stdout, format, first, &chain, &stats);
+                first = 0;
+            }
+        }
+
+        print_footer(stdout, format);
+
+        return 0;
+    }
+
+    print_header(stdout, format);
+
+    for (w = 0; w < sweep.n_kinds; ++w) {
+        for (p = 0; p < sweep.n_policies; ++p) {
+            for (c = 0; c < sweep.n_capacities; ++c) {
+                for (k = 0; k < sweep.n_keys; ++k) {
+                    attr.wl.kind = sweep.kinds[w];
+                    attr.cache.policy = sweep.policies[p];
+                    attr.capacity = sweep.capacities[c];
+                    attr.wl.n_keys = sweep.keys[k];
+                    attr.n_warmup = warmup < 0 ? attr.capacity : warmup;
+
+                    bench_run(&attr, &res);
+                    print_result(stdout, format, first, &attr, &res);
+                    first = 0;
+
+                    /* A generated cache is LRU and not thread safe. */
+                    if (!generated || attr.resize ||
+                        attr.cache.policy != LRU_CACHE_POLICY_LRU ||
+                        attr.cache.n_shards)
+                        continue;
+
+                    attr.generated = 1;
+                    bench_run(&attr, &res);
+                    print_result(stdout, format, first, &attr, &res);
+                    attr.generated = 0;
+                }
+            }
+        }
+    }
+
+    print_footer(stdout, format);
+
+    return 0;
+}
@@ -0,0 +1,173 @@
+/**
+ * @file
+ *
+ * Workloads for LRU cache benchmark
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "lru_cache/log.h"
+#include "wl.h"
+
+struct wl {
+    struct wl_attr attr;
+    unsigned long long rnd;
+    unsigned next;
+    /* The Zipfian generator constants, see wl_zipf(). */
+    double zetan;
+    double alpha;
+    double eta;
+    double half_pow;
+};
+
+static char const *const wl_kind_names[] = {
+    [WL_UNIFORM] = "uniform",
+    [WL_ZIPF] = "zipf",
+    [WL_SCAN] = "scan",
+    [WL_CRAWL] = "crawl",
+};
+
+int wl_kind_parse(char const *name, enum wl_kind *kind)
+{
+    unsigned i;
+
+    for (i = 0; i < sizeof(wl_kind_names) / sizeof(wl_kind_names[0]); ++i) {
+        if (!strcmp(name, wl_kind_names[i])) {
+            *kind = i;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+char const *wl_kind_name(enum wl_kind kind)
+{
+    return wl_kind_names[kind];
+}
+
+/* xorshift64* */
+static unsigned long long wl_rand(struct wl *wl)
+{
+    wl->rnd ^= wl->rnd >> 12;
+    wl->rnd ^= wl->rnd << 25;
+    wl->rnd ^= wl->rnd >> 27;
+
+    return wl->rnd * 0x2545f4914f6cdd1dULL;
+}
+
+/* A random number within [0, 1). */
+static double wl_rand_unit(struct wl *wl)
+{
+    return (wl_rand(wl) >> 11) * (1.0 / (1ULL << 53));
+}
+
+static double wl_zeta(unsigned n, double theta)
+{
+    static unsigned cached_n;
+    static double cached_theta;
+    static double cached_zeta;
+    double zeta = 0;
+    unsigned i;
+
+    /* Generators of a sweep share the constant, it takes O(n) to get. */
+    if (cached_n == n && cached_theta == theta)
+        return cached_zeta;
+
+    for (i = 1; i <= n; ++i)
+        zeta += 1.0 / pow(i, theta);
+
+    cached_n = n;
+    cached_theta = theta;
+    cached_zeta = zeta;
+
+    return zeta;
+}
+
+static void wl_zipf_init(struct wl *wl)
+{
+    double theta = wl->attr.skew;
+    unsigned n = wl->attr.n_keys;
+    double zeta2 = 1.0 + 1.0 / pow(2, theta);
+
+    die_on(theta <= 0 || theta >= 1, "zipf skew must be within (0, 1)\n");
+
+    wl->zetan = wl_zeta(n, theta);
+    wl->alpha = 1.0 / (1.0 - theta);
+    wl->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / wl->zetan);
+    wl->half_pow = 1.0 + pow(0.5, theta);
+}
+
+/*
+ * Gray et al., Quickly Generating Billion-Record Synthetic Databases.
+ */
+static unsigned wl_zipf(struct wl *wl)
+{
+    double u = wl_rand_unit(wl);
+    double uz = u * wl->zetan;
+    unsigned rank;
+
+    if (uz < 1.0)
+        return 0;
+    if (uz < wl->half_pow)
+        return 1;
+
+    rank = wl->attr.n_keys * pow(wl->eta * u - wl->eta + 1.0, wl->alpha);
+
+    return rank < wl->attr.n_keys ? rank : wl->attr.n_keys - 1;
+}
+
+struct wl *wl_alloc(struct wl_attr const *attr, unsigned seed)
+{
+    struct wl *wl = malloc(sizeof(*wl));
+
+    die_on(!wl, "failed to allocate workload\n");
+    die_on(!attr->n_keys, "workload needs keys\n");
+
+    wl->attr = *attr;
+    wl->rnd = 0x9e3779b97f4a7c15ULL * (seed + 1ULL);
+    wl->next = seed % attr->n_keys;
+
+    if (attr->kind == WL_ZIPF || attr->kind == WL_CRAWL)
+        wl_zipf_init(wl);
+
+    return wl;
+}
+
+void wl_free(struct wl *wl)
+{
+    free(wl);
+}
+
+void wl_next(struct wl *wl, struct wl_op *op)
+{
+    switch (wl->attr.kind) {
+    case WL_UNIFORM:
+        op->key = wl_rand(wl) % wl->attr.n_keys;
+        break;
+    case WL_ZIPF:
+        op->key = wl_zipf(wl);
+        break;
+    case WL_SCAN:
+        op->key = wl->next;
+        if (++wl->next == wl->attr.n_keys)
+            wl->next = 0;
+        break;
+    case WL_CRAWL:
+        if (wl_rand(wl) >> 63) {
+            op->key = wl_zipf(wl);
+            break;
+        }
+        op->key = wl->attr.n_keys + wl->next;
+        if (++wl->next == wl->attr.n_keys)
+            wl->next = 0;
+        break;
+    default:
+        ASSERT(0);
+    }
+
+    op->get = wl_rand_unit(wl) < wl->attr.read_ratio;
+}
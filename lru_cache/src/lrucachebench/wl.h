@@ -0,0 +1,69 @@
+/**
+ * @file
+ *
+ * Workloads for LRU cache benchmark
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#ifndef WL_H
+#define WL_H
+
+/** The distribution of keys. */
+enum wl_kind {
+    /** Every key is equally likely. */
+    WL_UNIFORM = 0,
+    /** The key of rank i is chosen with the probability ~ 1 / i^skew. */
+    WL_ZIPF,
+    /** Keys are accessed in turn. */
+    WL_SCAN,
+    /**
+     * Every other key is Zipfian, the rest are a scan of as many other
+     * keys, as a crawler passing through the keys once does.
+     */
+    WL_CRAWL,
+};
+
+struct wl_attr {
+    enum wl_kind kind;
+    /** The Zipfian skew within (0, 1). */
+    double skew;
+    /** The share of gets within [0, 1], the rest are puts. */
+    double read_ratio;
+    /**
+     * The number of keys within [0, n_keys), the crawl workload scans
+     * [n_keys, 2 * n_keys) too.
+     */
+    unsigned n_keys;
+};
+
+/** A workload operation. */
+struct wl_op {
+    /** 1 for a get or 0 for a put. */
+    int get;
+    int key;
+};
+
+struct wl;
+
+/**
+ * Create a workload generator.
+ *
+ * @param seed The seed of the generator, generators with different
+ *             seeds produce different sequences.
+ */
+extern struct wl *wl_alloc(struct wl_attr const *attr, unsigned seed);
+extern void wl_free(struct wl *wl);
+
+/** Generate the next operation. */
+extern void wl_next(struct wl *wl, struct wl_op *op);
+
+/**
+ * Get the kind of a workload by name.
+ *
+ * @retval 0 if the name is known or -1 otherwise.
+ */
+extern int wl_kind_parse(char const *name, enum wl_kind *kind);
+extern char const *wl_kind_name(enum wl_kind kind);
+
+#endif /* WL_H */
@@ -7,158 +7,127 @@
  * @copyright GPL-3.0+
  */
 #include <stdlib.h>
-#include <stdarg.h>
-#include <sys/queue.h>
+#include <string.h>
+#include <unistd.h>
 #include "lru_cache/log.h"
 #include "lru_cache/lru_cache.h"
+#include "trace.h"
 #include "cmdd.h"
 
 #ifndef UNUSED
 #define UNUSED(_x) (void)(_x)
 #endif
 
+/*
+ * The commands are two JSON arrays: the names and the arguments of the
+ * commands, e.g.
+ *   ["LRUCache", "put", "get"]
+ *   [[2], [1, 1], [1]]
+ *
+ * The names are read first and saved into a temporary file as one byte
+ * per command. Then, the arguments are read and every command is run as
+ * soon as its arguments are read, so neither the commands nor the results
+ * are kept in memory.
+ *
+ * The commands can be converted into a binary trace instead of running
+ * them, see trace.h.
+ */
+
+#define CMDD_MAX_NAME 16
+#define CMDD_MAX_ARGC 2
+#define CMDD_OUT_BUF_SIZE (1U << 20)
+
 enum cmdd_op {
     CMDD_OP_ALLOC = 0,
     CMDD_OP_PUT,
     CMDD_OP_GET,
 };
 
-enum cmdd_print_flag {
-    CMDD_PRINT_NAME = 0,
-    CMDD_PRINT_ARGV,
+enum cmdd_mode {
+    /** Run JSON commands. */
+    CMDD_MODE_RUN = 0,
+    /** Convert JSON commands into a binary trace. */
+    CMDD_MODE_CONVERT,
+    /** Replay a binary trace. */
+    CMDD_MODE_REPLAY,
 };
 
-struct cmdd_cmd;
-struct cmdd_out;
-
-typedef struct cmdd_out *(*cmdd_run_cmd_t)(struct cmdd *cmdd,
-                                           struct cmdd_cmd *cmd);
-typedef void (*cmdd_print_cmd_t)(struct cmdd *cmdd, struct cmdd_cmd *cmd,
-                                 FILE *fp, enum cmdd_print_flag flag);
+typedef void (*cmdd_run_cmd_t)(struct cmdd *cmdd, int const *argv, FILE *fp);
 
 struct cmdd_cmd_ops {
+    char const *name;
+    unsigned argc;
     cmdd_run_cmd_t run;
-    cmdd_print_cmd_t print;
-};
-
-struct cmdd_cmd {
-    SIMPLEQ_ENTRY(cmdd_cmd) next;
-    struct cmdd_cmd_ops const *ops;
-    union {
-        struct {
-            unsigned capacity;
-        } a;
-        struct {
-            int key;
-            int value;
-        } p;
-        struct {
-            int key;
-        } g;
-    };
-};
-
-struct cmdd_out {
-    SIMPLEQ_ENTRY(cmdd_out) next;
-    char *out;
+    enum trace_op trace_op;
 };
 
 struct cmdd {
-    SIMPLEQ_HEAD(, cmdd_cmd) cmds;
-    SIMPLEQ_HEAD(, cmdd_out) outs;
+    enum cmdd_mode mode;
+    /** The commands. */
+    FILE *in;
+    char const *in_path;
+    /** The command codes read from the names. */
+    FILE *ops;
+    /** The binary trace to convert the commands into. */
+    char const *trace_path;
+    /** The example commands to print. */
+    char const *preset;
     struct lru_cache *cache;
+    /** The number of commands run or converted. */
+    unsigned long n_cmds;
 };
 
-static struct cmdd_out *cmdd_run_alloc(struct cmdd *cmdd,
-                                       struct cmdd_cmd *cmd);
-static struct cmdd_out *cmdd_run_put(struct cmdd *cmdd,
-                                     struct cmdd_cmd *cmd);
-static struct cmdd_out *cmdd_run_get(struct cmdd *cmdd,
-                                     struct cmdd_cmd *cmd);
+typedef void (*cmdd_cmd_fn_t)(struct cmdd *cmdd,
+                              struct cmdd_cmd_ops const *ops,
+                              int const *argv, FILE *fp);
 
-static void cmdd_print_alloc(struct cmdd *cmdd, struct cmdd_cmd *cmd,
-                             FILE *fp, enum cmdd_print_flag flag);
-static void cmdd_print_put(struct cmdd *cmdd, struct cmdd_cmd *cmd,
-                           FILE *fp, enum cmdd_print_flag flag);
-static void cmdd_print_get(struct cmdd *cmdd, struct cmdd_cmd *cmd,
-                           FILE *fp, enum cmdd_print_flag flag);
+static void cmdd_run_alloc(struct cmdd *cmdd, int const *argv, FILE *fp);
+static void cmdd_run_put(struct cmdd *cmdd, int const *argv, FILE *fp);
+static void cmdd_run_get(struct cmdd *cmdd, int const *argv, FILE *fp);
 
 static struct cmdd_cmd_ops const cmdd_cmd_ops[] = {
     [CMDD_OP_ALLOC] = {
+        .name = "LRUCache",
+        .argc = 1,
         .run = cmdd_run_alloc,
-        .print = cmdd_print_alloc,
+        .trace_op = TRACE_OP_ALLOC,
     },
     [CMDD_OP_PUT] = {
+        .name = "put",
+        .argc = 2,
         .run = cmdd_run_put,
-        .print = cmdd_print_put,
+        .trace_op = TRACE_OP_PUT,
     },
     [CMDD_OP_GET] = {
+        .name = "get",
+        .argc = 1,
         .run = cmdd_run_get,
-        .print = cmdd_print_get,
+        .trace_op = TRACE_OP_GET,
     },
 };
 
-static struct cmdd_cmd *cmdd_cmd_alloc(enum cmdd_op op, ...)
-{
-    struct cmdd_cmd *cmd = malloc(sizeof(*cmd));
-    va_list ap;
-
-    die_on(!cmd, "failed to allocate command\n");
-
-    va_start(ap, op);
-    switch (op) {
-    case CMDD_OP_ALLOC:
-        cmd->ops = &cmdd_cmd_ops[CMDD_OP_ALLOC];
-        cmd->a.capacity = va_arg(ap, unsigned);
-        break;
-    case CMDD_OP_PUT:
-        cmd->ops = &cmdd_cmd_ops[CMDD_OP_PUT];
-        cmd->p.key = va_arg(ap, int);
-        cmd->p.value = va_arg(ap, int);
-        break;
-    case CMDD_OP_GET:
-        cmd->ops = &cmdd_cmd_ops[CMDD_OP_GET];
-        cmd->g.key = va_arg(ap, int);
-        break;
-    default:
-        ASSERT(0);
-    }
-    va_end(ap);
-
-    return cmd;
-}
-
-static void cmdd_cmd_free(struct cmdd_cmd *cmd)
-{
-    free(cmd);
-}
-
-static struct cmdd_out *cmdd_out_alloc(char const *fmt, ...)
-{
-    struct cmdd_out *out = malloc(sizeof(*out));
-    va_list ap;
-    int n;
-
-    die_on(!out, "failed to allocate memory to save result\n");
+#define CMDD_N_OPS (sizeof(cmdd_cmd_ops) / sizeof(cmdd_cmd_ops[0]))
 
-    va_start(ap, fmt);
-    n = vsnprintf(NULL, 0, fmt, ap);
-    va_end(ap);
+static char const cmdd_preset[] =
+    "[\"LRUCache\", \"put\", \"put\", \"get\", \"put\", \"get\", \"put\", "
+    "\"get\", \"get\", \"get\"]\n"
+    "[[2], [1, 1], [2, 2], [1], [3, 3], [2], [4, 4], [1], [3], [4]]\n";
 
-    out->out = malloc(n + 1);
-    die_on(!out, "failed to allocate memory to save result string\n");
-
-    va_start(ap, fmt);
-    vsnprintf(out->out, n + 1, fmt, ap);
-    va_end(ap);
-
-    return out;
-}
-
-static void cmdd_out_free(struct cmdd_out *out)
+static void cmdd_usage(FILE *fp, char const *name)
 {
-    free(out->out);
-    free(out);
+    fprintf(fp,
+            "Usage: %s [-b | -c TRACE] [FILE]\n"
+            "Run LRU cache commands and print their results.\n"
+            "\n"
+            "FILE keeps two JSON arrays: the command names and the command\n"
+            "arguments. With FILE -, read stdin. With no FILE, run the\n"
+            "example commands.\n"
+            "\n"
+            "  -b        FILE is a binary trace, replay it and print the\n"
+            "            summary\n"
+            "  -c TRACE  convert the commands into the binary TRACE\n"
+            "  -h        print this help\n",
+            name);
 }
 
 static struct cmdd *cmdd_alloc(void)
@@ -167,32 +136,28 @@ static struct cmdd *cmdd_alloc(void)
 
     die_on(!cmdd, "failed to allocate cmdd\n");
 
-    SIMPLEQ_INIT(&cmdd->cmds);
-    SIMPLEQ_INIT(&cmdd->outs);
+    cmdd->mode = CMDD_MODE_RUN;
+    cmdd->in = NULL;
+    cmdd->in_path = NULL;
+    cmdd->ops = NULL;
+    cmdd->trace_path = NULL;
+    cmdd->preset = NULL;
     cmdd->cache = NULL;
+    cmdd->n_cmds = 0;
 
     return cmdd;
 }
 
 void cmdd_free(struct cmdd *cmdd)
 {
-    struct cmdd_cmd *cmd;
-    struct cmdd_out *out;
-
     if (cmdd->cache)
         lru_cache_free(cmdd->cache);
 
-    while (!SIMPLEQ_EMPTY(&cmdd->cmds)) {
-        cmd = SIMPLEQ_FIRST(&cmdd->cmds);
-        SIMPLEQ_REMOVE_HEAD(&cmdd->cmds, next);
-        cmdd_cmd_free(cmd);
-    }
+    if (cmdd->ops)
+        fclose(cmdd->ops);
 
-    while (!SIMPLEQ_EMPTY(&cmdd->outs)) {
-        out = SIMPLEQ_FIRST(&cmdd->outs);
-        SIMPLEQ_REMOVE_HEAD(&cmdd->outs, next);
-        cmdd_out_free(out);
-    }
+    if (cmdd->in && cmdd->in != stdin)
+        fclose(cmdd->in);
 
     free(cmdd);
 }
@@ -200,175 +165,295 @@ void cmdd_free(struct cmdd *cmdd)
 struct cmdd *cmdd_parse(int argc, char **argv)
 {
     struct cmdd *cmdd = cmdd_alloc();
-    struct cmdd_cmd *cmd;
-
-    UNUSED(argc);
-    UNUSED(argv);
-
-    /*
-     * TODO(Boris Stankevich): Read commands from the command line.
-     *
-     * For now, commands are preset.
-     */
-    cmd = cmdd_cmd_alloc(CMDD_OP_ALLOC, 2);
-    SIMPLEQ_INSERT_TAIL(&cmdd->cmds, cmd, next);
-    cmd = cmdd_cmd_alloc(CMDD_OP_PUT, 1, 1);
-    SIMPLEQ_INSERT_TAIL(&cmdd->cmds, cmd, next);
-    cmd = cmdd_cmd_alloc(CMDD_OP_PUT, 2, 2);
-    SIMPLEQ_INSERT_TAIL(&cmdd->cmds, cmd, next);
-    cmd = cmdd_cmd_alloc(CMDD_OP_GET, 1);
-    SIMPLEQ_INSERT_TAIL(&cmdd->cmds, cmd, next);
-    cmd = cmdd_cmd_alloc(CMDD_OP_PUT, 3, 3);
-    SIMPLEQ_INSERT_TAIL(&cmdd->cmds, cmd, next);
-    cmd = cmdd_cmd_alloc(CMDD_OP_GET, 2);
-    SIMPLEQ_INSERT_TAIL(&cmdd->cmds, cmd, next);
-    cmd = cmdd_cmd_alloc(CMDD_OP_PUT, 4, 4);
-    SIMPLEQ_INSERT_TAIL(&cmdd->cmds, cmd, next);
-    cmd = cmdd_cmd_alloc(CMDD_OP_GET, 1);
-    SIMPLEQ_INSERT_TAIL(&cmdd->cmds, cmd, next);
-    cmd = cmdd_cmd_alloc(CMDD_OP_GET, 3);
-    SIMPLEQ_INSERT_TAIL(&cmdd->cmds, cmd, next);
-    cmd = cmdd_cmd_alloc(CMDD_OP_GET, 4);
-    SIMPLEQ_INSERT_TAIL(&cmdd->cmds, cmd, next);
+    int opt;
+
+    while ((opt = getopt(argc, argv, "bc:h")) != -1) {
+        switch (opt) {
+        case 'b':
+            cmdd->mode = CMDD_MODE_REPLAY;
+            break;
+        case 'c':
+            cmdd->mode = CMDD_MODE_CONVERT;
+            cmdd->trace_path = optarg;
+            break;
+        case 'h':
+            cmdd_usage(stdout, argv[0]);
+            exit(0);
+        default:
+            cmdd_usage(stderr, argv[0]);
+            exit(1);
+        }
+    }
+
+    die_on(argc - optind > 1, "too many arguments\n");
+
+    if (cmdd->mode == CMDD_MODE_REPLAY) {
+        die_on(optind == argc, "no trace to replay\n");
+        cmdd->in_path = argv[optind];
+        return cmdd;
+    }
+
+    if (optind == argc) {
+        cmdd->preset = cmdd_preset;
+        cmdd->in = fmemopen((void *) cmdd_preset, sizeof(cmdd_preset) - 1,
+                            "r");
+    } else if (!strcmp(argv[optind], "-")) {
+        cmdd->in = stdin;
+    } else {
+        cmdd->in = fopen(argv[optind], "r");
+    }
+    die_on(!cmdd->in, "failed to open commands\n");
+
+    cmdd->ops = tmpfile();
+    die_on(!cmdd->ops, "failed to create a temporary file\n");
 
     return cmdd;
 }
 
-static struct cmdd_out *
-cmdd_run_alloc(struct cmdd *cmdd, struct cmdd_cmd *cmd)
+/* Get the next character that is not a space. */
+static int cmdd_next(struct cmdd *cmdd)
 {
-    if (cmdd->cache)
-        lru_cache_free(cmdd->cache);
+    int c;
 
-    cmdd->cache = lru_cache_alloc(cmd->a.capacity);
+    do {
+        c = getc_unlocked(cmdd->in);
+    } while (c == ' ' || c == '\t' || c == '\n' || c == '\r');
 
-    return cmdd_out_alloc("null");
+    return c;
 }
 
-static struct cmdd_out *
-cmdd_run_put(struct cmdd *cmdd, struct cmdd_cmd *cmd)
+static void cmdd_expect(struct cmdd *cmdd, int c)
 {
-    ASSERT(cmdd->cache);
+    int got = cmdd_next(cmdd);
+
+    die_on(got != c, "expected '%c' in commands, got '%c'\n", c, got);
+}
+
+/* Get the code of the command with a name. */
+static enum cmdd_op cmdd_read_name(struct cmdd *cmdd)
+{
+    char name[CMDD_MAX_NAME + 1];
+    unsigned n = 0;
+    unsigned i;
+    int c;
+
+    while ((c = getc_unlocked(cmdd->in)) != '"') {
+        die_on(c == EOF || n == CMDD_MAX_NAME, "invalid command name\n");
+        name[n++] = c;
+    }
+    name[n] = '\0';
 
-    lru_cache_put(cmdd->cache, cmd->p.key, cmd->p.value);
+    for (i = 0; i < CMDD_N_OPS; ++i) {
+        if (!strcmp(name, cmdd_cmd_ops[i].name))
+            return i;
+    }
 
-    return cmdd_out_alloc("null");
+    die("unknown command '%s'\n", name);
 }
 
-static struct cmdd_out *
-cmdd_run_get(struct cmdd *cmdd, struct cmdd_cmd *cmd)
+static void cmdd_read_names(struct cmdd *cmdd)
 {
-    int value;
+    int c;
+
+    cmdd_expect(cmdd, '[');
 
-    ASSERT(cmdd->cache);
+    c = cmdd_next(cmdd);
+    if (c == ']')
+        return;
 
-    value = lru_cache_get(cmdd->cache, cmd->g.key);
+    for (;;) {
+        die_on(c != '"', "expected a command name\n");
+        putc_unlocked(cmdd_read_name(cmdd), cmdd->ops);
+
+        c = cmdd_next(cmdd);
+        if (c == ']')
+            break;
+        die_on(c != ',', "expected ',' between command names\n");
+        c = cmdd_next(cmdd);
+    }
 
-    return cmdd_out_alloc("%d", value);
+    die_on(fflush(cmdd->ops) || fseek(cmdd->ops, 0, SEEK_SET),
+           "failed to save command names\n");
 }
 
-void cmdd_run(struct cmdd *cmdd)
+static int cmdd_read_int(struct cmdd *cmdd, int c)
 {
-    struct cmdd_cmd *cmd;
-    struct cmdd_out *out;
+    long long n = 0;
+    int neg = c == '-';
 
-    SIMPLEQ_FOREACH(cmd, &cmdd->cmds, next) {
-        out = cmd->ops->run(cmdd, cmd);
-        SIMPLEQ_INSERT_TAIL(&cmdd->outs, out, next);
+    if (neg)
+        c = getc_unlocked(cmdd->in);
+    die_on(c < '0' || c > '9', "expected a number\n");
+
+    for (; c >= '0' && c <= '9'; c = getc_unlocked(cmdd->in)) {
+        n = n * 10 + (c - '0');
+        die_on(n > 1LL << 31, "number is out of range\n");
     }
+    ungetc(c, cmdd->in);
+
+    if (neg)
+        n = -n;
+    die_on(n > 0x7fffffffLL, "number is out of range\n");
+
+    return n;
 }
 
-static void cmdd_print_alloc(struct cmdd *cmdd, struct cmdd_cmd *cmd,
-                             FILE *fp, enum cmdd_print_flag flag)
+/* Read the arguments of a command, @retval The number of them. */
+static unsigned cmdd_read_args(struct cmdd *cmdd, int *argv)
 {
-    UNUSED(cmdd);
-
-    switch (flag) {
-    case CMDD_PRINT_NAME:
-        fprintf(fp, "\"LRUCache\"");
-        break;
-    case CMDD_PRINT_ARGV:
-        fprintf(fp, "[%u]", cmd->a.capacity);
-        break;
-    default:
-        ASSERT(0);
+    unsigned n = 0;
+    int c;
+
+    c = cmdd_next(cmdd);
+    if (c == ']')
+        return 0;
+
+    for (;;) {
+        die_on(n == CMDD_MAX_ARGC, "too many command arguments\n");
+        argv[n++] = cmdd_read_int(cmdd, c);
+
+        c = cmdd_next(cmdd);
+        if (c == ']')
+            return n;
+        die_on(c != ',', "expected ',' between command arguments\n");
+        c = cmdd_next(cmdd);
     }
 }
 
-static void cmdd_print_put(struct cmdd *cmdd, struct cmdd_cmd *cmd,
-                             FILE *fp, enum cmdd_print_flag flag)
+static void cmdd_print_int(FILE *fp, int value)
 {
-    UNUSED(cmdd);
+    char buf[16];
+    char *p = buf + sizeof(buf);
+    unsigned u = value < 0 ? -(unsigned) value : (unsigned) value;
 
-    switch (flag) {
-    case CMDD_PRINT_NAME:
-        fprintf(fp, "\"put\"");
-        break;
-    case CMDD_PRINT_ARGV:
-        fprintf(fp, "[%d, %d]", cmd->p.key, cmd->p.value);
-        break;
-    default:
-        ASSERT(0);
-    }
+    do {
+        *--p = '0' + u % 10;
+        u /= 10;
+    } while (u);
+
+    if (value < 0)
+        *--p = '-';
+
+    fwrite(p, 1, buf + sizeof(buf) - p, fp);
 }
 
-static void cmdd_print_get(struct cmdd *cmdd, struct cmdd_cmd *cmd,
-                             FILE *fp, enum cmdd_print_flag flag)
+static void cmdd_run_alloc(struct cmdd *cmdd, int const *argv, FILE *fp)
 {
-    UNUSED(cmdd);
+    die_on(argv[0] <= 0, "invalid capacity %d\n", argv[0]);
 
-    switch (flag) {
-    case CMDD_PRINT_NAME:
-        fprintf(fp, "\"get\"");
-        break;
-    case CMDD_PRINT_ARGV:
-        fprintf(fp, "[%d]", cmd->g.key);
-        break;
-    default:
-        ASSERT(0);
-    }
+    if (cmdd->cache)
+        lru_cache_free(cmdd->cache);
+
+    cmdd->cache = lru_cache_alloc(argv[0]);
+
+    fputs("null", fp);
 }
 
-static void
-cmdd_print_cmds(struct cmdd *cmdd, FILE *fp, enum cmdd_print_flag flag)
+static void cmdd_run_put(struct cmdd *cmdd, int const *argv, FILE *fp)
 {
-    struct cmdd_cmd *cmd;
-    int next;
-
-    fprintf(fp, "[");
-    next = 0;
-    SIMPLEQ_FOREACH(cmd, &cmdd->cmds, next) {
-        if (next)
-            fprintf(fp, ", ");
-        else
-            next = 1;
-        cmd->ops->print(cmdd, cmd, fp, flag);
-    }
-    fprintf(fp, "]\n");
+    die_on(!cmdd->cache, "put before LRUCache\n");
+
+    lru_cache_put(cmdd->cache, argv[0], argv[1]);
+
+    fputs("null", fp);
 }
 
-static void cmdd_print_outs(struct cmdd *cmdd, FILE *fp)
+static void cmdd_run_get(struct cmdd *cmdd, int const *argv, FILE *fp)
 {
-    struct cmdd_out *out;
-    int next = 0;
+    die_on(!cmdd->cache, "get before LRUCache\n");
 
-    fprintf(fp, "[");
-    SIMPLEQ_FOREACH(out, &cmdd->outs, next) {
-        if (next)
-            fprintf(fp, ", ");
+    cmdd_print_int(fp, lru_cache_get(cmdd->cache, argv[0]));
+}
+
+/* Run a command and print its result. */
+static void cmdd_exec(struct cmdd *cmdd, struct cmdd_cmd_ops const *ops,
+                      int const *argv, FILE *fp)
+{
+    if (cmdd->n_cmds++)
+        fputs(", ", fp);
+
+    ops->run(cmdd, argv, fp);
+}
+
+/* Write a command into the trace. */
+static void cmdd_convert(struct cmdd *cmdd, struct cmdd_cmd_ops const *ops,
+                         int const *argv, FILE *fp)
+{
+    ++cmdd->n_cmds;
+
+    trace_write(fp, ops->trace_op, argv[0], ops->argc > 1 ? argv[1] : 0, 0);
+}
+
+/* Read the commands and pass every one to a function in turn. */
+static void cmdd_stream(struct cmdd *cmdd, cmdd_cmd_fn_t fn, FILE *fp)
+{
+    int argv[CMDD_MAX_ARGC];
+    struct cmdd_cmd_ops const *ops;
+    unsigned argc;
+    int op;
+    int c;
+
+    cmdd_read_names(cmdd);
+    cmdd_expect(cmdd, '[');
+
+    c = cmdd_next(cmdd);
+    while (c != ']') {
+        die_on(c != '[', "expected command arguments\n");
+
+        op = getc_unlocked(cmdd->ops);
+        die_on(op == EOF, "more arguments than command names\n");
+        ops = cmdd_cmd_ops + op;
+
+        argc = cmdd_read_args(cmdd, argv);
+        die_on(argc != ops->argc, "%s expects %u arguments, got %u\n",
+               ops->name, ops->argc, argc);
+
+        fn(cmdd, ops, argv, fp);
+
+        c = cmdd_next(cmdd);
+        if (c == ',')
+            c = cmdd_next(cmdd);
         else
-            next = 1;
-        fprintf(fp, "%s", out->out);
+            die_on(c != ']', "expected ',' between command arguments\n");
     }
-    fprintf(fp, "]\n");
+
+    die_on(getc_unlocked(cmdd->ops) != EOF,
+           "more command names than arguments\n");
 }
 
-void cmdd_print(struct cmdd *cmdd, FILE *fp)
+void cmdd_run(struct cmdd *cmdd, FILE *fp)
 {
-    fprintf(fp, "Input\n");
-    cmdd_print_cmds(cmdd, fp, CMDD_PRINT_NAME);
-    cmdd_print_cmds(cmdd, fp, CMDD_PRINT_ARGV);
+    FILE *trace;
+
+    switch (cmdd->mode) {
+    case CMDD_MODE_RUN:
+        setvbuf(fp, NULL, _IOFBF, CMDD_OUT_BUF_SIZE);
+
+        if (cmdd->preset)
+            fprintf(fp, "Input\n%sOutput\n", cmdd->preset);
+
+        fputc('[', fp);
+        cmdd_stream(cmdd, cmdd_exec, fp);
+        fputs("]\n", fp);
+        break;
+    case CMDD_MODE_CONVERT:
+        trace = fopen(cmdd->trace_path, "w");
+        die_on(!trace, "failed to create trace %s\n", cmdd->trace_path);
+        setvbuf(trace, NULL, _IOFBF, CMDD_OUT_BUF_SIZE);
+
+        trace_write_hdr(trace, 0);
+        cmdd_stream(cmdd, cmdd_convert, trace);
+        die_on(fclose(trace), "failed to write trace %s\n",
+                              cmdd->trace_path);
+
+        fprintf(fp, "converted %lu commands\n", cmdd->n_cmds);
+        break;
+    case CMDD_MODE_REPLAY:
+        trace_replay(cmdd->in_path, fp);
+        break;
+    default:
+        ASSERT(0);
+    }
 
-    fprintf(fp, "Output\n");
-    cmdd_print_outs(cmdd, fp);
+    fflush(fp);
 }
@@ -13,13 +13,22 @@
 
 struct cmdd;
 
-/** Create cmdd for commands on the command line */
+/**
+ * Create cmdd for commands on the command line.
+ *
+ * The commands are read from the file given, or stdin for "-", as two
+ * JSON arrays: the command names and the command arguments. With no file
+ * the example commands are used.
+ */
 extern struct cmdd *cmdd_parse(int argc, char **argv);
 extern void cmdd_free(struct cmdd *cmdd);
 
-extern void cmdd_run(struct cmdd *cmdd);
-
-/** Print a cmdd results. */
-extern void cmdd_print(struct cmdd *cmdd, FILE *fp);
+/**
+ * Run the commands and print the results as they are produced.
+ *
+ * The commands are streamed, so the memory does not depend on their
+ * number.
+ */
+extern void cmdd_run(struct cmdd *cmdd, FILE *fp);
 
 #endif /* CMDD_H */
@@ -13,8 +13,7 @@ int main(int argc, char **argv)
 {
     struct cmdd *cmdd = cmdd_parse(argc, argv);
 
-    cmdd_run(cmdd);
-    cmdd_print(cmdd, stdout);
+    cmdd_run(cmdd, stdout);
     cmdd_free(cmdd);
 
     return 0;
@@ -0,0 +1,120 @@
+/**
+ * @file
+ *
+ * Binary traces of LRU cache commands
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lru_cache/log.h"
+#include "lru_cache/lru_cache.h"
+#include "trace.h"
+
+void trace_write_hdr(FILE *fp, uint32_t flags)
+{
+    struct trace_hdr hdr = {
+        .version = TRACE_VERSION,
+        .flags = flags,
+    };
+
+    BUILD_ASSERT(sizeof(hdr.magic) == sizeof(TRACE_MAGIC) - 1);
+
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    die_on(fwrite(&hdr, sizeof(hdr), 1, fp) != 1,
+           "failed to write trace header\n");
+}
+
+void trace_write(FILE *fp, enum trace_op op, int key, int value, uint32_t ts)
+{
+    struct trace_rec rec = {
+        .op = op,
+        .key = key,
+        .value = value,
+        .ts = ts,
+    };
+
+    die_on(fwrite(&rec, sizeof(rec), 1, fp) != 1,
+           "failed to write trace record\n");
+}
+
+static double trace_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void trace_replay(char const *path, FILE *fp)
+{
+    struct lru_cache *cache = NULL;
+    struct trace_hdr const *hdr;
+    struct trace_rec const *first;
+    struct trace_rec const *rec;
+    struct trace_rec const *end;
+    unsigned long long gets = 0;
+    unsigned long long hits = 0;
+    struct stat st;
+    double t;
+    void *map;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    die_on(fd < 0, "failed to open trace %s\n", path);
+    die_on(fstat(fd, &st), "failed to stat trace %s\n", path);
+    die_on((size_t) st.st_size < sizeof(*hdr) ||
+           (st.st_size - sizeof(*hdr)) % sizeof(*rec),
+           "invalid trace size %lld\n", (long long) st.st_size);
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    die_on(map == MAP_FAILED, "failed to map trace %s\n", path);
+    close(fd);
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    hdr = map;
+    die_on(memcmp(hdr->magic, TRACE_MAGIC, sizeof(hdr->magic)) ||
+           hdr->version != TRACE_VERSION, "invalid trace header\n");
+
+    first = (struct trace_rec const *) (hdr + 1);
+    end = (struct trace_rec const *) ((char const *) map + st.st_size);
+
+    t = trace_now();
+    for (rec = first; rec < end; ++rec) {
+        switch (rec->op) {
+        case TRACE_OP_ALLOC:
+            die_on(rec->key <= 0, "invalid capacity %d\n", rec->key);
+            if (cache)
+                lru_cache_free(cache);
+            cache = lru_cache_alloc(rec->key);
+            break;
+        case TRACE_OP_PUT:
+            die_on(!cache, "put before alloc\n");
+            lru_cache_put(cache, rec->key, rec->value);
+            break;
+        case TRACE_OP_GET:
+            die_on(!cache, "get before alloc\n");
+            hits += lru_cache_get(cache, rec->key) != -1;
+            ++gets;
+            break;
+        default:
+            die("invalid trace op %u\n", rec->op);
+        }
+    }
+    t = trace_now() - t;
+
+    fprintf(fp, "ops %llu gets %llu hits %llu seconds %.6f ops/sec %.0f\n",
+            (unsigned long long) (end - first), gets, hits, t,
+            t > 0 ? (end - first) / t : 0);
+
+    if (cache)
+        lru_cache_free(cache);
+    munmap(map, st.st_size);
+}
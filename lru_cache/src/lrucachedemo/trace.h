@@ -0,0 +1,62 @@
+/**
+ * @file
+ *
+ * Binary traces of LRU cache commands
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * A trace is a header followed by fixed size records in the host byte
+ * order, so it is replayed from a mapping of the file as is.
+ */
+
+#define TRACE_MAGIC "LRUTRACE"
+#define TRACE_VERSION 1U
+
+/** Records have timestamps. */
+#define TRACE_F_TS 0x1U
+
+enum trace_op {
+    /** Create a new cache, the key is the capacity. */
+    TRACE_OP_ALLOC = 0,
+    TRACE_OP_PUT,
+    TRACE_OP_GET,
+};
+
+struct trace_hdr {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+};
+
+struct trace_rec {
+    uint32_t op;
+    int32_t key;
+    /** The value for TRACE_OP_PUT or 0. */
+    int32_t value;
+    /** Microseconds since the previous record with TRACE_F_TS or 0. */
+    uint32_t ts;
+};
+
+/** Write the header of a trace. */
+extern void trace_write_hdr(FILE *fp, uint32_t flags);
+
+/** Write a record of a trace. */
+extern void trace_write(FILE *fp, enum trace_op op, int key, int value,
+                        uint32_t ts);
+
+/**
+ * Replay a trace file.
+ *
+ * The results of gets are not printed, the summary of the replay is.
+ */
+extern void trace_replay(char const *path, FILE *fp);
+
+#endif /* TRACE_H */
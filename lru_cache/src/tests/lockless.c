@@ -0,0 +1,189 @@
+/**
+ * @file
+ *
+ * Lockless lookup tests
+ *
+ * Readers look keys up without locks while a writer puts, expires and
+ * resizes, every value found must be one written for its key. Build it
+ * with -fsanitize=thread to check the races of the lookups too.
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "lru_cache/log.h"
+#include "lru_cache/lru_cache.h"
+
+#define TEST_READERS 3U
+#define TEST_SHARDS 4U
+#define TEST_CAPACITY 1024U
+/* The int keys and the byte keys, twice as many as the frames. */
+#define TEST_KEYS (2 * TEST_CAPACITY)
+#define TEST_ROUNDS 16U
+#define TEST_VALUE_MAX 64U
+
+struct test_ctx {
+    struct lru_cache *cache;
+    int stop;
+};
+
+struct test_reader {
+    pthread_t thread;
+    struct test_ctx *ctx;
+    unsigned seed;
+};
+
+static unsigned test_rand(unsigned *seed)
+{
+    *seed = *seed * 1103515245U + 12345U;
+
+    return *seed >> 8;
+}
+
+/* The int value of a key keeps the key and the round it is put by. */
+static int test_value(unsigned key, unsigned round)
+{
+    return (int) (key << 8 | (round & 0xff));
+}
+
+/*
+ * The bytes value of a key is its key followed by a length depending on
+ * the round, filled with the low byte of the key.
+ */
+static unsigned test_bytes(uint64_t key, unsigned round, unsigned char *buf)
+{
+    unsigned len = sizeof(key) + round % (TEST_VALUE_MAX - sizeof(key));
+
+    memcpy(buf, &key, sizeof(key));
+    memset(buf + sizeof(key), (unsigned char) key, len - sizeof(key));
+
+    return len;
+}
+
+static uint64_t test_bytes_key(unsigned key)
+{
+    return (uint64_t) key << 32 | 0x5a5a5a5aU;
+}
+
+static void test_check_bytes(uint64_t key, unsigned char const *buf,
+                             long len)
+{
+    long i;
+
+    die_on(len < (long) sizeof(key) || len > (long) TEST_VALUE_MAX,
+           "key %llx has a value of %ld bytes\n", (unsigned long long) key,
+           len);
+    die_on(memcmp(buf, &key, sizeof(key)),
+           "key %llx has a value of another key\n",
+           (unsigned long long) key);
+
+    for (i = sizeof(key); i < len; ++i)
+        die_on(buf[i] != (unsigned char) key,
+               "key %llx has a torn value at %ld\n",
+               (unsigned long long) key, i);
+}
+
+static void *test_read(void *arg)
+{
+    struct test_reader *r = arg;
+    unsigned char buf[TEST_VALUE_MAX];
+    uint64_t bkey;
+    unsigned key;
+    long len;
+    int value;
+
+    while (!__atomic_load_n(&r->ctx->stop, __ATOMIC_RELAXED)) {
+        key = test_rand(&r->seed) % TEST_KEYS;
+
+        value = lru_cache_get(r->ctx->cache, key);
+        if (value != -1) {
+            die_on((unsigned) value >> 8 != key,
+                   "key %u has the value %d of another key\n", key, value);
+        }
+
+        bkey = test_bytes_key(key);
+        len = lru_cache_copy_bytes(r->ctx->cache, &bkey, sizeof(bkey), buf,
+                                   sizeof(buf));
+        if (len != -1)
+            test_check_bytes(bkey, buf, len);
+    }
+
+    return NULL;
+}
+
+/*
+ * Put every key once a round, the byte keys of every other round with a
+ * TTL so they expire, and resize the cache every 4 rounds.
+ */
+static void test_write(struct test_ctx *ctx, unsigned seed)
+{
+    unsigned char buf[TEST_VALUE_MAX];
+    unsigned round;
+    unsigned len;
+    unsigned key;
+    unsigned i;
+    uint64_t bkey;
+
+    for (round = 0; round < TEST_ROUNDS; ++round) {
+        for (i = 0; i < TEST_KEYS; ++i) {
+            key = test_rand(&seed) % TEST_KEYS;
+            lru_cache_put(ctx->cache, key, test_value(key, round));
+
+            bkey = test_bytes_key(key);
+            len = test_bytes(bkey, round + i, buf);
+            lru_cache_put_bytes_ttl(ctx->cache, &bkey, sizeof(bkey), buf,
+                                    len, round % 2);
+        }
+
+        if (round % 4 == 3)
+            lru_cache_resize(ctx->cache, TEST_CAPACITY / (round / 4 % 3 + 1));
+    }
+}
+
+static void test_policy(enum lru_cache_policy policy)
+{
+    struct lru_cache_attr attr = {
+        .policy = policy,
+        .n_shards = TEST_SHARDS,
+        .lockless = 1,
+    };
+    struct test_reader readers[TEST_READERS];
+    struct test_ctx ctx;
+    unsigned i;
+    int rc;
+
+    ctx.cache = lru_cache_alloc_attr(TEST_CAPACITY, &attr);
+    ctx.stop = 0;
+
+    for (i = 0; i < TEST_READERS; ++i) {
+        readers[i].ctx = &ctx;
+        readers[i].seed = i + 1;
+
+        rc = pthread_create(&readers[i].thread, NULL, test_read,
+                            readers + i);
+        die_on(rc, "failed to create thread: %d\n", rc);
+    }
+
+    test_write(&ctx, policy + 1);
+
+    __atomic_store_n(&ctx.stop, 1, __ATOMIC_RELAXED);
+    for (i = 0; i < TEST_READERS; ++i)
+        pthread_join(readers[i].thread, NULL);
+
+    lru_cache_free(ctx.cache);
+}
+
+int main(void)
+{
+    test_policy(LRU_CACHE_POLICY_LRU);
+    test_policy(LRU_CACHE_POLICY_CLOCK);
+    test_policy(LRU_CACHE_POLICY_TINYLFU);
+    test_policy(LRU_CACHE_POLICY_SLRU);
+    test_policy(LRU_CACHE_POLICY_ARC);
+
+    return 0;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file
+ *
+ * Timing wheel tests
+ *
+ * @author Boris Stankevich <microsoft-wanted@yandex.ru>
+ * @copyright GPL-3.0+
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "lru_cache/log.h"
+#include "lru_cache/twheel.h"
+
+/* A day of millisecond ticks. */
+#define TEST_DAY (24ULL * 60 * 60 * 1000)
+
+#define TEST_FRAMES 256U
+
+struct test_ctx {
+    /** The tick the wheel is advanced to. */
+    uint64_t now;
+    /** The tick every frame expires at or 0. */
+    uint64_t expire[TEST_FRAMES];
+    unsigned n_expired;
+};
+
+static void test_expire(void *arg, unsigned idx)
+{
+    struct test_ctx *ctx = arg;
+
+    die_on(ctx->expire[idx] > ctx->now,
+           "frame %u expired at %llu before %llu\n", idx,
+           (unsigned long long) ctx->now,
+           (unsigned long long) ctx->expire[idx]);
+
+    ctx->expire[idx] = 0;
+    ++ctx->n_expired;
+}
+
+static void test_advance(struct twheel *tw, struct test_ctx *ctx,
+                         uint64_t now)
+{
+    unsigned i;
+
+    ctx->now = now;
+    twheel_advance(tw, now, test_expire, ctx);
+
+    for (i = 0; i < TEST_FRAMES; ++i)
+        die_on(ctx->expire[i] && ctx->expire[i] <= now,
+               "frame %u not expired at %llu by %llu\n", i,
+               (unsigned long long) ctx->expire[i],
+               (unsigned long long) now);
+}
+
+static void test_add(struct twheel *tw, struct test_ctx *ctx, unsigned idx,
+                     uint64_t expire)
+{
+    twheel_add(tw, idx, expire);
+    ctx->expire[idx] = twheel_expire(tw, idx);
+}
+
+/* A key put after the wheel has been empty for a day. */
+static void test_idle(void)
+{
+    struct test_ctx ctx = { 0 };
+    struct twheel *tw = twheel_alloc(TEST_FRAMES, 1, NULL);
+
+    test_add(tw, &ctx, 0, 10);
+    test_advance(tw, &ctx, 10);
+    die_on(ctx.n_expired != 1, "frame not expired before the idle time\n");
+
+    /* A put advances the empty wheel before it adds. */
+    test_advance(tw, &ctx, TEST_DAY);
+    test_add(tw, &ctx, 1, TEST_DAY + 1000);
+    die_on(ctx.expire[1] != TEST_DAY + 1000, "expiration moved\n");
+    test_advance(tw, &ctx, TEST_DAY + 999);
+    die_on(ctx.n_expired != 1, "frame expired early after the idle time\n");
+    test_advance(tw, &ctx, TEST_DAY + 1000);
+    die_on(ctx.n_expired != 2, "frame not expired after the idle time\n");
+
+    twheel_free(tw);
+}
+
+/* A key added to a wheel left behind is far beyond the top level. */
+static void test_stale(void)
+{
+    struct test_ctx ctx = { 0 };
+    struct twheel *tw = twheel_alloc(TEST_FRAMES, 1, NULL);
+
+    test_add(tw, &ctx, 0, 365 * TEST_DAY);
+    test_advance(tw, &ctx, 365 * TEST_DAY - 1);
+    die_on(ctx.n_expired, "frame expired early\n");
+    test_advance(tw, &ctx, 365 * TEST_DAY);
+    die_on(ctx.n_expired != 1, "frame not expired\n");
+
+    twheel_free(tw);
+}
+
+/* Frames added and removed at random while the wheel jumps at random. */
+static void test_random(void)
+{
+    struct test_ctx ctx = { 0 };
+    struct twheel *tw = twheel_alloc(TEST_FRAMES, 1, NULL);
+    uint64_t now = 1;
+    unsigned i;
+    unsigned idx;
+
+    srand(1);
+
+    for (i = 0; i < 200000; ++i) {
+        idx = rand() % TEST_FRAMES;
+
+        if (rand() % 4 == 0) {
+            twheel_rm(tw, idx);
+            ctx.expire[idx] = 0;
+        } else if (!ctx.expire[idx]) {
+            /* Delays from a tick to beyond the reach of the wheel. */
+            test_add(tw, &ctx, idx, now + (1ULL << (rand() % 30)) +
+                                    rand() % 64);
+        }
+
+        now += rand() % 8 ? (uint64_t) (rand() % 64) : 1ULL << (rand() % 24);
+        test_advance(tw, &ctx, now);
+    }
+
+    twheel_free(tw);
+}
+
+int main(void)
+{
+    test_idle();
+    test_stale();
+    test_random();
+
+    return 0;
+}